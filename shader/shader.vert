@@ -5,20 +5,28 @@
 // right handed system, -Y is up normally but I flipped the rasterizer
 // depth goes from 0 to 1 as object gets farther away
 
-layout (location = 0) in vec3 position;
-layout (location = 1) in vec3 normal;
+// packed vertex format, see pvert.hpp. the formats there do the snorm and half float conversion
+layout (location = 0) in vec4 qposition; // snorm16 in the mesh bounds
+layout (location = 1) in vec2 qnormal; // octahedral
 layout (location = 2) in vec2 texcoord;
-layout (location = 3) in vec3 tangent;
+layout (location = 3) in vec2 qtangent; // octahedral
 
 layout (set = 0, binding = 0) uniform uniformBuffer {
-	mat4 model;
 	mat4 view;
 	mat4 proj;
+	vec4 posScale;
+	vec4 posOffset;
+	vec4 eye; // camera position
 } ubo;
 
-layout (push_constant) uniform push_data {
-	vec3 c;
-} pd;
+struct instance {
+	mat4 model;
+	uint batch;
+};
+
+layout (std430, set = 0, binding = 2) readonly buffer instanceBuffer {
+	instance instances[];
+};
 
 layout (location = 0) out vec3 p;
 layout (location = 1) out vec3 n;
@@ -27,19 +35,32 @@ layout (location = 3) out vec3 eye;
 
 layout (location = 4) out mat3 tbn;
 
+vec3 octDecode(vec2 e) {
+	vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-v.z, 0.0);
+	v.x += v.x >= 0.0 ? -t : t;
+	v.y += v.y >= 0.0 ? -t : t;
+	return normalize(v);
+}
+
 void main() {
-	vec4 p4 = ubo.model * vec4(position, 1.0);
+	vec3 position = ubo.posOffset.xyz + qposition.xyz * ubo.posScale.xyz;
+	vec3 normal = octDecode(qnormal);
+	vec3 tangent = octDecode(qtangent);
+
+	mat4 model = instances[gl_InstanceIndex].model;
+	vec4 p4 = model * vec4(position, 1.0);
 
 	gl_Position = ubo.proj * ubo.view * p4;
 	
 	p = p4.xyz;
-	n = mat3(ubo.model) * normal;
+	n = mat3(model) * normal;
 	uv = texcoord;
-	eye = pd.c;
+	eye = ubo.eye.xyz;
 
 	// create a change of basis matrix to map normal map vertices to world space normals
-	vec3 t = normalize(mat3(ubo.model) * tangent);
-	vec3 nfull = normalize(mat3(ubo.model) * normal);
+	vec3 t = normalize(mat3(model) * tangent);
+	vec3 nfull = normalize(mat3(model) * normal);
 	vec3 b = cross(nfull, t);
 	tbn = mat3(t, b, nfull);
 }
@@ -1,5 +1,12 @@
 #include "main.hpp"
 
+#include "options.hpp"
+
+#include <chrono>
+
+#include "imgui.h"
+#include "imgui_impl_vulkan.h"
+
 void appvk::createCommandPool() {
     VkCommandPoolCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
@@ -9,6 +16,13 @@ void appvk::createCommandPool() {
     if (vkCreateCommandPool(dev, &createInfo, nullptr, &cp) != VK_SUCCESS) {
         throw std::runtime_error("cannot create command pool!");
     }
+
+    createInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT; // upload command buffers are short-lived
+    createInfo.queueFamilyIndex = tQueueFamily;
+
+    if (vkCreateCommandPool(dev, &createInfo, nullptr, &tcp) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create transfer command pool!");
+    }
 }
 
 VkCommandBuffer appvk::beginSingleCommand() {
@@ -45,9 +59,9 @@ void appvk::endSingleCommand(VkCommandBuffer buf) {
     vkFreeCommandBuffers(dev, cp, 1, &buf);
 }
 
-// need to create a command buffer per swapchain image
+// one per frame in flight, reused once beginFrame has waited for the frame that last used it
 void appvk::allocRenderCmdBuffers() {
-    commandBuffers.resize(swapFramebuffers.size());
+    commandBuffers.resize(options::maxFramesInFlight);
     
     VkCommandBufferAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -60,5 +74,227 @@ void appvk::allocRenderCmdBuffers() {
         throw std::runtime_error("cannot create command buffers!");
     }
 
-    // we could record command buffers here, but since the ui needs to be re-recorded every frame there isn't much point...?
-}
\ No newline at end of file
+    // the primaries only run the cull pass and the secondaries from recordSecondaries, which keeps the scene's draws
+    // around between frames, so these are cheap to re-record every frame
+}
+
+void appvk::createRecorders() {
+    recordPool.emplace(options::recordThreads);
+    recorders.resize(options::maxFramesInFlight * options::recordThreads);
+
+    for (size_t i = 0; i < recorders.size(); i++) {
+        recorder& r = recorders[i];
+
+        // contiguous slices, so each worker binds as little as it can
+        size_t slice = i % options::recordThreads;
+        r.begin = things.size() * slice / options::recordThreads;
+        r.end = things.size() * (slice + 1) / options::recordThreads;
+
+        VkCommandPoolCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        createInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT; // reset as a whole every time the frame comes around
+        createInfo.queueFamilyIndex = gQueueFamily;
+
+        if (vkCreateCommandPool(dev, &createInfo, nullptr, &r.pool) != VK_SUCCESS) {
+            throw std::runtime_error("cannot create recorder command pool!");
+        }
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = r.pool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY; // only run from inside a primary's render pass
+        allocInfo.commandBufferCount = r.bufs.size();
+
+        if (vkAllocateCommandBuffers(dev, &allocInfo, r.bufs.data()) != VK_SUCCESS) {
+            throw std::runtime_error("cannot create recorder command buffers!");
+        }
+    }
+
+    recordings.resize(options::maxFramesInFlight);
+    uiBuffers.resize(options::maxFramesInFlight);
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = cp; // only the main thread uses cp
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+    allocInfo.commandBufferCount = uiBuffers.size();
+
+    if (vkAllocateCommandBuffers(dev, &allocInfo, uiBuffers.data()) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create ui command buffers!");
+    }
+}
+
+void appvk::destroyRecorders() {
+    recordPool.reset();
+
+    for (recorder& r : recorders) {
+        vkDestroyCommandPool(dev, r.pool, nullptr); // frees its buffers too
+    }
+
+    recorders.clear();
+    recordings.clear();
+
+    vkFreeCommandBuffers(dev, cp, uiBuffers.size(), uiBuffers.data());
+    uiBuffers.clear();
+}
+
+// secondaries don't inherit any state, so everything is bound again. may run on any thread.
+// the result is reused for every frame that currFrame comes around again until the scene changes, so nothing per
+// frame or per swapchain image can be recorded into it. the viewport follows the swapchain's size, a resize bumps
+// sceneVersion.
+void appvk::recordThings(VkCommandBuffer cbuf, size_t begin, size_t end, uint32_t phase) {
+    VkCommandBufferInheritanceInfo inheritInfo{};
+    inheritInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritInfo.renderPass = (phase == 0) ? earlyPass : renderPass;
+    inheritInfo.subpass = 0;
+    inheritInfo.framebuffer = VK_NULL_HANDLE; // the late pass' framebuffer changes with the swapchain image
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = &inheritInfo;
+
+    if (vkBeginCommandBuffer(cbuf, &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("cannot begin recording secondary command buffer!");
+    }
+
+    VkViewport viewport{};
+    viewport.x = 0.0f;
+    viewport.y = swapExtent.height;
+    viewport.width = swapExtent.width;
+    // Vulkan says -Y is up, not down, flip so we're compatible with OpenGL code and obj models
+    viewport.height = -1.0f * swapExtent.height;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+
+    VkRect2D scissor{};
+    scissor.offset = {0, 0};
+    scissor.extent = swapExtent;
+
+    vkCmdSetViewport(cbuf, 0, 1, &viewport);
+    vkCmdSetScissor(cbuf, 0, 1, &scissor);
+
+    // every mesh is in the same two buffers, only the index type can change between draws
+    VkDeviceSize offset = 0;
+    vkCmdBindVertexBuffers(cbuf, 0, 1, &meshes.vert.buf, &offset);
+
+    std::optional<VkIndexType> indexType;
+
+    for (size_t i = begin; i < end; i++) {
+        const thing& t = things[i];
+        const mesh& m = meshes.meshes[t.meshId];
+
+        if (indexType != m.indexType) {
+            vkCmdBindIndexBuffer(cbuf, meshes.index.buf, 0, m.indexType);
+            indexType = m.indexType;
+        }
+
+        // binding order: ubo, then this frame's instance region
+        std::array<uint32_t, 2> offsets = {t.uboOffset, uint32_t(currFrame * instances.regionSize)};
+
+        // every set in dsets points at the same buffers and textures
+        const VkDescriptorSet& set = t.dsets[currFrame % t.dsets.size()];
+
+        vkCmdBindPipeline(cbuf, VK_PIPELINE_BIND_POINT_GRAPHICS, t.pipe);
+        vkCmdBindDescriptorSets(cbuf, VK_PIPELINE_BIND_POINT_GRAPHICS, t.pipeLayout, 0, 1, &set, offsets.size(), offsets.data());
+        drawCulled(cbuf, t, i, phase);
+    }
+
+    if (vkEndCommandBuffer(cbuf) != VK_SUCCESS) {
+        throw std::runtime_error("cannot record into secondary command buffer!");
+    }
+}
+
+// if the scene changed since this frame in flight last recorded it, the workers start recording both passes' draws
+// while this thread gets on with the primary. executeSecondaries waits for them.
+void appvk::recordSecondaries() {
+    using clock = std::chrono::steady_clock;
+
+    // uniform allocations happen in the same order every frame, so the offsets normally match too
+    sceneRecording& rec = recordings[currFrame];
+    bool stale = rec.version != sceneVersion || rec.uboOffsets.size() != things.size();
+    for (size_t i = 0; !stale && i < things.size(); i++) {
+        stale = rec.uboOffsets[i] != things[i].uboOffset;
+    }
+
+    if (stale) {
+        rec.version = sceneVersion;
+        rec.uboOffsets.resize(things.size());
+        for (size_t i = 0; i < things.size(); i++) {
+            rec.uboOffsets[i] = things[i].uboOffset;
+        }
+
+        sceneRecords++;
+
+        recordPool->dispatch(options::recordThreads, [this](size_t slice) {
+            recorder& r = recorders[currFrame * options::recordThreads + slice];
+            if (r.begin == r.end) {
+                return;
+            }
+
+            auto start = clock::now();
+
+            // beginFrame waited for the last frame to use this pool
+            vkResetCommandPool(dev, r.pool, 0);
+
+            for (uint32_t phase = 0; phase < r.bufs.size(); phase++) {
+                recordThings(r.bufs[phase], r.begin, r.end, phase);
+            }
+
+            r.ms = std::chrono::duration<float, std::milli>(clock::now() - start).count();
+        });
+
+        recordingScene = true;
+    }
+}
+
+// recorded before the primary gets to the late pass it runs in, so its scope names that as its parent
+void appvk::recordUi(uint32_t image) {
+    VkCommandBufferInheritanceInfo inheritInfo{};
+    inheritInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritInfo.renderPass = renderPass;
+    inheritInfo.subpass = 0;
+    inheritInfo.framebuffer = swapFramebuffers[image];
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = &inheritInfo;
+
+    // implicitly reset, cp allows resetting single buffers
+    if (vkBeginCommandBuffer(uiBuffers[currFrame], &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("cannot begin recording ui command buffer!");
+    }
+
+    beginScope(uiBuffers[currFrame], "ui", "late pass");
+    ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), uiBuffers[currFrame]);
+    endScope(uiBuffers[currFrame]);
+
+    if (vkEndCommandBuffer(uiBuffers[currFrame]) != VK_SUCCESS) {
+        throw std::runtime_error("cannot record into ui command buffer!");
+    }
+}
+
+// the ui is drawn last, on top of the late pass. the first call waits for the workers if they were recording.
+void appvk::executeSecondaries(VkCommandBuffer cbuf, uint32_t phase) {
+    if (recordingScene) {
+        recordPool->wait();
+        recordingScene = false;
+    }
+
+    std::vector<VkCommandBuffer> bufs;
+    for (size_t s = 0; s < options::recordThreads; s++) {
+        const recorder& r = recorders[currFrame * options::recordThreads + s];
+        if (r.begin != r.end) {
+            bufs.push_back(r.bufs[phase]);
+        }
+    }
+
+    if (phase == 1) {
+        bufs.push_back(uiBuffers[currFrame]);
+    }
+
+    if (!bufs.empty()) {
+        vkCmdExecuteCommands(cbuf, bufs.size(), bufs.data());
+    }
+}
@@ -15,15 +15,13 @@ void appvk::createComputeBuffers() {
     }
 
     ibuf = createBuffer(bufsize * sizeof(glm::vec4), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, vmem::usage::upload);
     
+    // read back on the cpu, so this wants cached memory
     obuf = createBuffer(bufsize * sizeof(glm::vec4), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, vmem::usage::readback);
     
-    void* data;
-    vkMapMemory(dev, ibuf.mem, 0, bufsize * sizeof(glm::vec4), 0, &data);
-    memcpy(data, hostbuf.data(), hostbuf.size() * sizeof(glm::vec4));
-    vkUnmapMemory(dev, ibuf.mem);
+    memcpy(ibuf.mem.mapped, hostbuf.data(), hostbuf.size() * sizeof(glm::vec4));
 }
 
 void appvk::createComputeDescriptors() {
@@ -99,15 +97,6 @@ void appvk::createComputeDescriptors() {
 }
 
 void appvk::createComputePipeline() {
-    std::vector<char> cspv = readFile(".spv/shader.comp.spv");
-    VkShaderModule cmod = createShaderModule(cspv);
-
-    VkPipelineShaderStageCreateInfo shaderCreateInfo{};
-    shaderCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    shaderCreateInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
-    shaderCreateInfo.module = cmod;
-    shaderCreateInfo.pName = "main";
-
     VkPipelineLayoutCreateInfo pipeLayoutCreateInfo{};
     pipeLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     pipeLayoutCreateInfo.setLayoutCount = 1;
@@ -117,16 +106,7 @@ void appvk::createComputePipeline() {
         throw std::runtime_error("cannot create compute pipeline layout!");
     }
 
-    VkComputePipelineCreateInfo createInfo{};
-    createInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
-    createInfo.stage = shaderCreateInfo;
-    createInfo.layout = cPipeLayout;
-
-    if (vkCreateComputePipelines(dev, VK_NULL_HANDLE, 1, &createInfo, nullptr, &cPipeline) != VK_SUCCESS) {
-        throw std::runtime_error("cannot create compute pipeline!");
-    }
-
-    vkDestroyShaderModule(dev, cmod, nullptr);
+    buildComputeAsync(".spv/shader.comp.spv", cPipeLayout, &cPipeline, "compute");
 }
 
 VkCommandBuffer appvk::createComputeCommandBuffer() {
@@ -153,9 +133,11 @@ VkCommandBuffer appvk::createComputeCommandBuffer() {
     beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
     vkBeginCommandBuffer(buf, &beginInfo);
+        cTimer = beginTimer(buf, cQueueFamily, "compute test");
         vkCmdBindDescriptorSets(buf, VK_PIPELINE_BIND_POINT_COMPUTE, cPipeLayout, 0, 1, &cDescSet, 0, nullptr);
         vkCmdBindPipeline(buf, VK_PIPELINE_BIND_POINT_COMPUTE, cPipeline);
         vkCmdDispatch(buf, bufsize / 128, 1, 1);
+        endTimer(buf, cTimer);
     vkEndCommandBuffer(buf);
 
     return buf;
@@ -171,13 +153,11 @@ void appvk::runCompute(VkCommandBuffer buf) {
     vkQueueWaitIdle(cQueue);
 
     vkFreeCommandBuffers(dev, ccp, 1, &buf);
+    readTimer(cTimer);
 
     std::vector<glm::vec4> cmpbuf(bufsize);
 
-    void* data;
-    vkMapMemory(dev, obuf.mem, 0, bufsize * sizeof(glm::vec4), 0, &data);
-    memcpy(cmpbuf.data(), data, cmpbuf.size() * sizeof(glm::vec4));
-    vkUnmapMemory(dev, obuf.mem);
+    memcpy(cmpbuf.data(), obuf.mem.mapped, cmpbuf.size() * sizeof(glm::vec4));
 
     bool err = false;
     for (size_t i = 0; i < bufsize; i++) {
@@ -0,0 +1,314 @@
+#include "main.hpp"
+
+#include "options.hpp"
+
+// matches drawInfo in cull.comp, std430
+struct drawInfo {
+    glm::vec4 sphere;
+    int32_t vertexOffset;
+    uint32_t lodCount;
+    uint32_t firstInstance;
+    uint32_t pad;
+    uint32_t lodFirstIndex[4];
+    uint32_t lodIndexCount[4];
+    float lodError[4];
+};
+
+static_assert(pvert::maxLods == 4, "cull.comp stores lods in 4 component vectors");
+
+// matches the cullData uniform in cull.comp, std140
+struct cullData {
+    glm::mat4 viewProj;
+    glm::vec4 planes[6];
+    glm::vec4 eye;
+    float lodErrorPixels;
+    uint32_t instanceCount;
+    uint32_t compact;
+    uint32_t batchCount;
+    uint32_t pyramidSize[2];
+    uint32_t pyramidLevels;
+    uint32_t instanceCapacity;
+};
+
+static_assert(sizeof(cullData) == 208, "cullData has to match its std140 layout");
+
+// triangles, visible, occluded and a padding word come before the per-thing draw counts of each phase
+static constexpr VkDeviceSize countHeader = 4 * sizeof(uint32_t);
+
+void appvk::createCullPass() {
+    cull.draws = createBuffer(things.size() * sizeof(drawInfo), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, vmem::usage::upload);
+
+    // early phase commands, then late phase commands
+    cull.commands = createBuffer(2 * instances.capacity * sizeof(VkDrawIndexedIndirectCommand),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    cull.countSize = countHeader + 2 * things.size() * sizeof(uint32_t);
+    cull.counts = createBuffer(cull.countSize,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    cull.stats = createBuffer(cull.countSize * options::maxFramesInFlight, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, vmem::usage::readback);
+    memset(cull.stats.mem.mapped, 0, cull.countSize * options::maxFramesInFlight);
+
+    // nothing was visible before the first frame, so it's all drawn late
+    cull.visibility = createBuffer(instances.capacity * sizeof(uint32_t),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    VkCommandBuffer fill = beginSingleCommand();
+    vkCmdFillBuffer(fill, cull.visibility.buf, 0, VK_WHOLE_SIZE, 0);
+    endSingleCommand(fill);
+
+    std::array<VkDescriptorSetLayoutBinding, 7> bindings = {};
+    for (size_t i = 0; i < bindings.size(); i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC; // this frame's instance region
+    bindings[5].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC; // cullData in the uniform ring
+    bindings[6].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER; // depth pyramid, written by recordCull
+
+    VkDescriptorSetLayoutCreateInfo layoutCreateInfo{};
+    layoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutCreateInfo.bindingCount = bindings.size();
+    layoutCreateInfo.pBindings = bindings.data();
+
+    if (vkCreateDescriptorSetLayout(dev, &layoutCreateInfo, nullptr, &cull.layout) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create cull descriptor set layout!");
+    }
+
+    std::array<VkDescriptorPoolSize, 4> sizes;
+    sizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    sizes[0].descriptorCount = options::maxFramesInFlight;
+    sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    sizes[1].descriptorCount = 4 * options::maxFramesInFlight;
+    sizes[2].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    sizes[2].descriptorCount = options::maxFramesInFlight;
+    sizes[3].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    sizes[3].descriptorCount = options::maxFramesInFlight;
+
+    VkDescriptorPoolCreateInfo poolCreateInfo{};
+    poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolCreateInfo.maxSets = options::maxFramesInFlight;
+    poolCreateInfo.poolSizeCount = sizes.size();
+    poolCreateInfo.pPoolSizes = sizes.data();
+
+    if (vkCreateDescriptorPool(dev, &poolCreateInfo, nullptr, &cull.pool) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create cull descriptor pool!");
+    }
+
+    std::vector<VkDescriptorSetLayout> layouts(options::maxFramesInFlight, cull.layout);
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = cull.pool;
+    allocInfo.descriptorSetCount = layouts.size();
+    allocInfo.pSetLayouts = layouts.data();
+
+    cull.sets.resize(options::maxFramesInFlight);
+    cull.pyramidBound.assign(options::maxFramesInFlight, 0); // generation 0 is never a real pyramid
+    if (vkAllocateDescriptorSets(dev, &allocInfo, cull.sets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create cull descriptor sets!");
+    }
+
+    std::array<VkDescriptorBufferInfo, 6> bufferInfos = {};
+    bufferInfos[0] = {instances.buf.buf, 0, instances.regionSize};
+    bufferInfos[1] = {cull.draws.buf, 0, VK_WHOLE_SIZE};
+    bufferInfos[2] = {cull.commands.buf, 0, VK_WHOLE_SIZE};
+    bufferInfos[3] = {cull.counts.buf, 0, VK_WHOLE_SIZE};
+    bufferInfos[4] = {cull.visibility.buf, 0, VK_WHOLE_SIZE};
+    bufferInfos[5] = {uniforms.buf.buf, 0, sizeof(cullData)};
+
+    // the pyramid binding is written by recordCull
+    for (VkDescriptorSet set : cull.sets) {
+        std::array<VkWriteDescriptorSet, 6> sets = {};
+        for (size_t i = 0; i < sets.size(); i++) {
+            sets[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            sets[i].dstSet = set;
+            sets[i].dstBinding = i;
+            sets[i].dstArrayElement = 0;
+            sets[i].descriptorCount = 1;
+            sets[i].descriptorType = bindings[i].descriptorType;
+            sets[i].pBufferInfo = &bufferInfos[i];
+        }
+
+        vkUpdateDescriptorSets(dev, sets.size(), sets.data(), 0, nullptr);
+    }
+
+    VkPushConstantRange pcr{};
+    pcr.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pcr.offset = 0;
+    pcr.size = sizeof(uint32_t); // the phase
+
+    VkPipelineLayoutCreateInfo pipeLayoutCreateInfo{};
+    pipeLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeLayoutCreateInfo.setLayoutCount = 1;
+    pipeLayoutCreateInfo.pSetLayouts = &cull.layout;
+    pipeLayoutCreateInfo.pushConstantRangeCount = 1;
+    pipeLayoutCreateInfo.pPushConstantRanges = &pcr;
+
+    if (vkCreatePipelineLayout(dev, &pipeLayoutCreateInfo, nullptr, &cull.pipeLayout) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create cull pipeline layout!");
+    }
+
+    buildComputeAsync(".spv/cull.comp.spv", cull.pipeLayout, &cull.pipe, "cull");
+}
+
+void appvk::destroyCullPass() {
+    vkDestroyPipeline(dev, cull.pipe, nullptr);
+    vkDestroyPipelineLayout(dev, cull.pipeLayout, nullptr);
+    vkDestroyDescriptorPool(dev, cull.pool, nullptr);
+    vkDestroyDescriptorSetLayout(dev, cull.layout, nullptr);
+
+    for (buffer* b : {&cull.draws, &cull.commands, &cull.counts, &cull.stats, &cull.visibility}) {
+        vkDestroyBuffer(dev, b->buf, nullptr);
+        allocator.free(b->mem);
+    }
+}
+
+// mesh bounds and lod ranges for every thing. only changes when meshes move, so the gpu must be idle.
+void appvk::writeDrawInfo() {
+    drawInfo* d = static_cast<drawInfo*>(cull.draws.mem.mapped);
+
+    for (size_t i = 0; i < things.size(); i++) {
+        const mesh& m = meshes.meshes[things[i].meshId];
+        const pvert::bounds& b = m.box;
+
+        glm::vec3 centre((b.min[0] + b.max[0]) * 0.5f, (b.min[1] + b.max[1]) * 0.5f, (b.min[2] + b.max[2]) * 0.5f);
+        float radius = glm::length(glm::vec3(b.max[0], b.max[1], b.max[2]) - centre);
+
+        d[i] = {};
+        d[i].sphere = glm::vec4(centre, radius);
+        d[i].vertexOffset = m.vertexOffset;
+        d[i].lodCount = m.lodCount;
+        d[i].firstInstance = things[i].firstInstance;
+
+        for (uint32_t l = 0; l < m.lodCount; l++) {
+            d[i].lodFirstIndex[l] = m.firstIndex + m.lods[l].firstIndex;
+            d[i].lodIndexCount[l] = m.lods[l].indexCount;
+            d[i].lodError[l] = m.lods[l].error;
+        }
+    }
+}
+
+// has to be outside a render pass. phase 0 is the early phase, 1 the late one which needs the depth pyramid.
+void appvk::recordCull(VkCommandBuffer cbuf, uint32_t phase) {
+    if (phase == 0) {
+        // the previous frame's draws, stats copy and visibility writes have to be done before anything is rewritten
+        VkMemoryBarrier reuse{};
+        reuse.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        reuse.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        reuse.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(cbuf, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &reuse, 0, nullptr, 0, nullptr);
+
+        vkCmdFillBuffer(cbuf, cull.counts.buf, 0, cull.countSize, 0);
+
+        VkMemoryBarrier cleared{};
+        cleared.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        cleared.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        cleared.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(cbuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &cleared, 0, nullptr, 0, nullptr);
+
+        // both phases read the same constants
+        cullData* d = static_cast<cullData*>(allocUniform(sizeof(cullData), cull.uboOffset));
+
+        // Gribb and Hartmann, planes straight out of the rows of the view projection matrix
+        const glm::mat4& m = viewProj;
+        auto row = [&](int r) { return glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]); };
+
+        d->viewProj = viewProj;
+        d->planes[0] = row(3) + row(0);
+        d->planes[1] = row(3) - row(0);
+        d->planes[2] = row(3) + row(1);
+        d->planes[3] = row(3) - row(1);
+        d->planes[4] = row(2); // depth is 0 to 1
+        d->planes[5] = row(3) - row(2);
+
+        for (glm::vec4& p : d->planes) {
+            p = p / glm::length(glm::vec3(p.x, p.y, p.z));
+        }
+
+        d->eye = glm::vec4(c.pos, pixelsPerUnit);
+        d->lodErrorPixels = options::lodErrorPixels;
+        d->instanceCount = instances.data.size();
+        d->compact = drawIndirectCount;
+        d->batchCount = things.size();
+        d->pyramidSize[0] = hiz.width;
+        d->pyramidSize[1] = hiz.height;
+        d->pyramidLevels = hiz.im.mipLevels;
+        d->instanceCapacity = instances.capacity;
+
+        // the last frame to use this set is done
+        if (cull.pyramidBound[currFrame] != hiz.generation) {
+            VkDescriptorImageInfo pyramidInfo = {hiz.samp, hiz.im.view, VK_IMAGE_LAYOUT_GENERAL};
+
+            VkWriteDescriptorSet pyramidSet{};
+            pyramidSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            pyramidSet.dstSet = cull.sets[currFrame];
+            pyramidSet.dstBinding = 6;
+            pyramidSet.dstArrayElement = 0;
+            pyramidSet.descriptorCount = 1;
+            pyramidSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            pyramidSet.pImageInfo = &pyramidInfo;
+
+            vkUpdateDescriptorSets(dev, 1, &pyramidSet, 0, nullptr);
+            cull.pyramidBound[currFrame] = hiz.generation;
+        }
+    }
+
+    std::array<uint32_t, 2> offsets = {uint32_t(currFrame * instances.regionSize), cull.uboOffset};
+
+    vkCmdBindPipeline(cbuf, VK_PIPELINE_BIND_POINT_COMPUTE, cull.pipe);
+    vkCmdBindDescriptorSets(cbuf, VK_PIPELINE_BIND_POINT_COMPUTE, cull.pipeLayout, 0, 1, &cull.sets[currFrame], offsets.size(), offsets.data());
+    vkCmdPushConstants(cbuf, cull.pipeLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &phase);
+    vkCmdDispatch(cbuf, (instances.data.size() + 63) / 64, 1, 1);
+
+    // the late phase adds to the same counters
+    VkMemoryBarrier written{};
+    written.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    written.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    written.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT |
+        VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(cbuf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0, 1, &written, 0, nullptr, 0, nullptr);
+
+    if (phase == 1) {
+        // read back once this frame is done
+        VkBufferCopy copy{};
+        copy.dstOffset = currFrame * cull.countSize;
+        copy.size = cull.countSize;
+        vkCmdCopyBuffer(cbuf, cull.counts.buf, cull.stats.buf, 1, &copy);
+    }
+}
+
+void appvk::drawCulled(VkCommandBuffer cbuf, const thing& t, uint32_t batch, uint32_t phase) {
+    constexpr uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+    VkDeviceSize first = (phase * instances.capacity + t.firstInstance) * stride;
+    VkDeviceSize count = countHeader + (phase * things.size() + batch) * sizeof(uint32_t);
+
+    if (drawIndirectCount) {
+        vkCmdDrawIndexedIndirectCount(cbuf, cull.commands.buf, first, cull.counts.buf, count, t.instanceCount, stride);
+    } else if (multiDrawIndirect) {
+        // culled instances are left in place with an instance count of 0
+        vkCmdDrawIndexedIndirect(cbuf, cull.commands.buf, first, t.instanceCount, stride);
+    } else {
+        for (uint32_t i = 0; i < t.instanceCount; i++) {
+            vkCmdDrawIndexedIndirect(cbuf, cull.commands.buf, first + i * stride, 1, stride);
+        }
+    }
+}
+
+// the last frame to use frame's slot is done
+void appvk::readCullStats(uint32_t frame) {
+    const uint32_t* counts = reinterpret_cast<const uint32_t*>(static_cast<const char*>(cull.stats.mem.mapped) + frame * cull.countSize);
+    cull.triangles = counts[0];
+    cull.visible = counts[1];
+    cull.occluded = counts[2];
+}
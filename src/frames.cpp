@@ -0,0 +1,236 @@
+#include "main.hpp"
+
+#include "options.hpp"
+
+#include <algorithm>
+
+void appvk::createSyncs() {
+    VkSemaphoreTypeCreateInfo typeInfo{};
+    typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    typeInfo.initialValue = framesSubmitted; // nothing to wait for
+
+    VkSemaphoreCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    createInfo.pNext = &typeInfo;
+
+    if (vkCreateSemaphore(dev, &createInfo, nullptr, &frameTimeline) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create frame timeline!");
+    }
+
+    createFrameSemaphores();
+}
+
+// the binary semaphores the swapchain needs, per frame in flight
+void appvk::createFrameSemaphores() {
+    imageAvailSems.resize(options::maxFramesInFlight, VK_NULL_HANDLE);
+    renderDoneSems.resize(options::maxFramesInFlight, VK_NULL_HANDLE);
+
+    VkSemaphoreCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    for (uint32_t i = 0; i < imageAvailSems.size(); i++) {
+        VkResult r1 = vkCreateSemaphore(dev, &createInfo, nullptr, &imageAvailSems[i]);
+        VkResult r2 = vkCreateSemaphore(dev, &createInfo, nullptr, &renderDoneSems[i]);
+
+        if (r1 != VK_SUCCESS || r2 != VK_SUCCESS) {
+            throw std::runtime_error("cannot create sync objects!");
+        }
+    }
+}
+
+void appvk::destroySyncs() {
+    for (uint32_t i = 0; i < imageAvailSems.size(); i++) {
+        vkDestroySemaphore(dev, imageAvailSems[i], nullptr);
+        vkDestroySemaphore(dev, renderDoneSems[i], nullptr);
+    }
+
+    imageAvailSems.clear();
+    renderDoneSems.clear();
+
+    vkDestroySemaphore(dev, frameTimeline, nullptr);
+}
+
+uint64_t appvk::framesCompleted() {
+    uint64_t value = 0;
+    if (vkGetSemaphoreCounterValue(dev, frameTimeline, &value) != VK_SUCCESS) {
+        throw std::runtime_error("cannot read frame timeline!");
+    }
+
+    return value;
+}
+
+void appvk::waitFrame(uint64_t frame) {
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &frameTimeline;
+    waitInfo.pValues = &frame;
+
+    if (vkWaitSemaphores(dev, &waitInfo, UINT64_MAX) != VK_SUCCESS) {
+        throw std::runtime_error("cannot wait for frame!");
+    }
+}
+
+// the next frame reuses the per frame resources of the one framesInFlight frames before it, so that one has to be done
+void appvk::beginFrame() {
+    currFrame = framesSubmitted % framesInFlight;
+
+    if (framesSubmitted >= framesInFlight) {
+        waitFrame(framesSubmitted + 1 - framesInFlight);
+    }
+
+    collectRetired();
+
+    std::lock_guard<std::mutex> lock(pacingLock);
+    frameRecords[(framesSubmitted + 1) % frameRecords.size()] = {std::chrono::steady_clock::now(), pacingConfig};
+}
+
+void appvk::endFrame() {
+    framesSubmitted++;
+
+    {
+        std::lock_guard<std::mutex> lock(pacingLock);
+        pacingSubmitted = framesSubmitted;
+    }
+
+    pacingWake.notify_one();
+}
+
+// called between frames. frames already in flight keep the combination they started with in their frameRecord.
+void appvk::applyFrameSettings() {
+    bool changed = false;
+
+    if (wantedFramesInFlight != framesInFlight) {
+        // currFrame is framesSubmitted % framesInFlight, so slots only line up with the frames using them again once
+        // nothing is in flight
+        waitFrame(framesSubmitted);
+        framesInFlight = wantedFramesInFlight;
+        changed = true;
+    }
+
+    // a minimised window leaves the present mode for next frame, the frame count has changed regardless
+    if (wantedPresentMode != requestedPresentMode && recreateSwapChain()) {
+        changed = true;
+    }
+
+    if (changed) {
+        usePacingConfig();
+        cout << "present mode " << presentModeName(presentMode) << ", " << framesInFlight << " frames in flight\n";
+    }
+}
+
+void appvk::usePacingConfig() {
+    std::lock_guard<std::mutex> lock(pacingLock);
+
+    for (size_t i = 0; i < pacing.size(); i++) {
+        if (pacing[i].mode == presentMode && pacing[i].framesInFlight == framesInFlight) {
+            pacingConfig = i;
+            return;
+        }
+    }
+
+    pacingStats s{};
+    s.mode = presentMode;
+    s.framesInFlight = framesInFlight;
+    pacing.push_back(s);
+    pacingConfig = pacing.size() - 1;
+}
+
+void appvk::startPacingWatcher() {
+    usePacingConfig();
+    pacingThread = std::thread(&appvk::watchFrames, this);
+}
+
+void appvk::stopPacingWatcher() {
+    {
+        std::lock_guard<std::mutex> lock(pacingLock);
+        pacingQuit = true;
+    }
+
+    pacingWake.notify_one();
+    if (pacingThread.joinable()) {
+        pacingThread.join();
+    }
+}
+
+// waiting on the timeline here rather than polling it from the main thread means a frame's finish time doesn't depend
+// on when the main thread next gets around to looking
+void appvk::watchFrames() {
+    using clock = std::chrono::steady_clock;
+    auto ms = [](clock::time_point a, clock::time_point b) { return std::chrono::duration<double, std::milli>(b - a).count(); };
+
+    uint64_t next = 1;
+    std::optional<clock::time_point> lastDone;
+    size_t lastConfig = 0;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(pacingLock);
+            pacingWake.wait(lock, [&] { return pacingQuit || pacingSubmitted >= next; });
+            if (pacingQuit) {
+                return;
+            }
+        }
+
+        // the frame has been submitted, so this finishes. the timeout only keeps shutdown from waiting on it
+        VkSemaphoreWaitInfo waitInfo{};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &frameTimeline;
+        waitInfo.pValues = &next;
+
+        VkResult r = vkWaitSemaphores(dev, &waitInfo, 100'000'000);
+        if (r == VK_TIMEOUT) {
+            continue;
+        } else if (r != VK_SUCCESS) {
+            return; // the main thread finds out on its own
+        }
+
+        auto done = clock::now();
+
+        std::lock_guard<std::mutex> lock(pacingLock);
+        const frameRecord& f = frameRecords[next % frameRecords.size()];
+        pacingStats& s = pacing[f.config];
+
+        float latency = float(ms(f.start, done));
+        s.frames++;
+        s.latencySum += latency;
+        s.latencyMax = std::max(s.latencyMax, latency);
+
+        // throughput only counts gaps between two frames of the same combination
+        if (lastDone && lastConfig == f.config) {
+            s.intervalSum += ms(*lastDone, done);
+            s.intervals++;
+        }
+
+        lastDone = done;
+        lastConfig = f.config;
+        next++;
+    }
+}
+
+void appvk::retire(std::function<void()> destroy) {
+    retired.push_back({framesSubmitted, std::move(destroy)});
+}
+
+void appvk::collectRetired() {
+    if (retired.empty()) {
+        return;
+    }
+
+    // everything is retired in submission order
+    uint64_t done = framesCompleted();
+    while (!retired.empty() && retired.front().frame <= done) {
+        retired.front().destroy();
+        retired.pop_front();
+    }
+}
+
+void appvk::flushRetired() {
+    for (retiredObject& r : retired) {
+        r.destroy();
+    }
+
+    retired.clear();
+}
@@ -1,7 +1,8 @@
 #include "main.hpp"
 #include "options.hpp"
 
-// stores framebuffer config
+// stores framebuffer config. the frame is split in two passes with the depth pyramid built in between: earlyPass
+// clears and draws what was visible last frame, renderPass loads that and draws the rest, then resolves.
 void appvk::createRenderPass() {
     std::array<VkAttachmentDescription, 3> attachments;
 
@@ -9,32 +10,32 @@ void appvk::createRenderPass() {
     attachments[0].flags = 0;
     attachments[0].format = swapFormat; // format from swapchain image
     attachments[0].samples = msaaSamples;
-    attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD; // earlyPass already drew into it
+    attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE; // only the resolved image is kept
     attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED; // layout of image before render pass - don't care since we'll be clearing it anyways
+    attachments[0].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL; // layout of image before render pass
     attachments[0].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL; // layout of image at end of render pass
 
     const std::vector<VkFormat> formatList = {
         VK_FORMAT_D24_UNORM_S8_UINT,
         VK_FORMAT_X8_D24_UNORM_PACK32, // no stencil
+        VK_FORMAT_D32_SFLOAT,
     };
 
-    // check to see if we can use a 24-bit depth component
-    depthFormat = findImageFormat(formatList, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+    // check to see if we can use a 24-bit depth component. the depth pyramid samples it, so it has to be sampleable
+    depthFormat = findImageFormat(formatList, VK_IMAGE_TILING_OPTIMAL,
+        VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
 
     // depth
     attachments[1].flags = 0;
     attachments[1].format = depthFormat;
     attachments[1].samples = msaaSamples; // depth buffer never gets presented, but we want a ms depth buffer to use with our ms color buffer
-    attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR; // depth has to be cleared to something before we use it
+    attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
     attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    // initialLayout needs to be set before we start rendering, otherwise
-    // clearing and a layout transition from undefined -> depth stencil optimal happen at the same time
-    attachments[1].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    attachments[1].initialLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL; // left there for the pyramid by earlyPass
     attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
     // resolve
@@ -70,14 +71,18 @@ void appvk::createRenderPass() {
     std::array<VkSubpassDependency, 1> deps = {};
     // there's a WAW dependency between writing images due to where imageAvailSems waits
     // solution here is to delay writing to the framebuffer until the image we need is acquired (and the transition has taken place)
-    
+
+    // earlyPass' color and depth writes have to land before we load them, and the pyramid build has to be done
+    // reading depth before it goes back to being an attachment
     deps[0].srcSubpass = VK_SUBPASS_EXTERNAL; // implicit subpass at start of render pass
-    deps[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT; // stage we're waiting on
-    deps[0].srcAccessMask = 0; // what we're using that input for
+    deps[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT; // stage we're waiting on
+    deps[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT; // what we're using that input for
 
     deps[0].dstSubpass = 0; // index into pSubpasses
-    deps[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT; // stage we write to
-    deps[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT; // what we're using that output for
+    deps[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT; // stage we write to
+    deps[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT; // what we're using that output for
 
     VkRenderPassCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
@@ -91,182 +96,198 @@ void appvk::createRenderPass() {
     if (vkCreateRenderPass(dev, &createInfo, nullptr, &renderPass) != VK_SUCCESS) {
         throw std::runtime_error("cannot create render pass!");
     }
+
+    // earlyPass has no resolve attachment. a render pass with one subpass ignores resolve attachments when checking
+    // compatibility, so pipelines made for renderPass work in both.
+    attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED; // don't care since we'll be clearing it anyways
+
+    attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR; // depth has to be cleared to something before we use it
+    attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    attachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    attachments[1].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    subs[0].pResolveAttachments = nullptr;
+
+    std::array<VkSubpassDependency, 2> earlyDeps = {};
+
+    // the depth buffer is shared between frames, so the previous frame's depth writes also need to finish before we clear it
+    earlyDeps[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    earlyDeps[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    earlyDeps[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    earlyDeps[0].dstSubpass = 0;
+    earlyDeps[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    earlyDeps[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+    // the pyramid build reads depth once the pass is done with it
+    earlyDeps[1].srcSubpass = 0;
+    earlyDeps[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    earlyDeps[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    earlyDeps[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    earlyDeps[1].dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    earlyDeps[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    createInfo.attachmentCount = 2;
+    createInfo.dependencyCount = earlyDeps.size();
+    createInfo.pDependencies = earlyDeps.data();
+
+    if (vkCreateRenderPass(dev, &createInfo, nullptr, &earlyPass) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create early render pass!");
+    }
 }
 
+// the layouts are made once, the pipelines themselves are built on buildPool. the job keeps copies of whatever it
+// needs from the render pass, since recreateSwapChain carries on while it runs.
 void appvk::createGraphicsPipeline() {
-    std::vector<char> vertspv = readFile(".spv/shader.vert.spv");
-    std::vector<char> fragspv = readFile(".spv/shader.frag.spv");
+    // they only depend on the set layouts, so they outlive any render pass
+    if (t.pipeLayout == VK_NULL_HANDLE) {
+        VkPipelineLayoutCreateInfo pipeLayoutCreateInfo{}; // for descriptor sets
+        pipeLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipeLayoutCreateInfo.setLayoutCount = 1;
+        pipeLayoutCreateInfo.pSetLayouts = &t.layout;
+        pipeLayoutCreateInfo.pushConstantRangeCount = 0; // the camera is in the ubo, so recorded draws don't bake it in
+
+        if (vkCreatePipelineLayout(dev, &pipeLayoutCreateInfo, nullptr, &t.pipeLayout) != VK_SUCCESS) {
+            throw std::runtime_error("cannot create obj pipeline layout!");
+        }
+
+        pipeLayoutCreateInfo.pSetLayouts = &flr.layout;
+    
+        if (vkCreatePipelineLayout(dev, &pipeLayoutCreateInfo, nullptr, &flr.pipeLayout) != VK_SUCCESS) {
+            throw std::runtime_error("cannot create flr pipeline layout!");
+        }
+    }
 
-    VkShaderModule vmod = createShaderModule(vertspv);
-    VkShaderModule fmod = createShaderModule(fragspv);
+    buildAsync([this, samples = msaaSamples, pass = renderPass] {
+        std::vector<char> vertspv = readFile(".spv/shader.vert.spv");
+        std::vector<char> fragspv = readFile(".spv/shader.frag.spv");
 
-    std::array<VkPipelineShaderStageCreateInfo, 2> shaders = {};
+        VkShaderModule vmod = createShaderModule(vertspv);
+        VkShaderModule fmod = createShaderModule(fragspv);
+
+        std::array<VkPipelineShaderStageCreateInfo, 2> shaders = {};
     
-    shaders[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    shaders[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-    shaders[0].module = vmod;
-    shaders[0].pName = "main";
+        shaders[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        shaders[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+        shaders[0].module = vmod;
+        shaders[0].pName = "main";
     
-    shaders[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    shaders[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    shaders[1].module = fmod;
-    shaders[1].pName = "main";
+        shaders[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        shaders[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+        shaders[1].module = fmod;
+        shaders[1].pName = "main";
     
-    VkVertexInputBindingDescription bindDesc;
-    bindDesc.binding = 0;
-    bindDesc.stride = sizeof(vformat::vertex);
-    bindDesc.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-    std::array<VkVertexInputAttributeDescription, 4> attrDesc;
-    for (size_t i = 0; i < attrDesc.size(); i++) {
-        attrDesc[i].location = i;
-        attrDesc[i].binding = 0;
-        attrDesc[i].offset = 16 * i; // all offsets are rounded up to 16 bytes due to alignas
-    }
-
-    attrDesc[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-    attrDesc[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-    attrDesc[2].format = VK_FORMAT_R32G32_SFLOAT;
-    attrDesc[3].format = VK_FORMAT_R32G32B32_SFLOAT;
+        // generated from pvert's attribute table at compile time
+        constexpr VkVertexInputBindingDescription bindDesc = pvert::bindingDescription(0);
+        constexpr auto attrDesc = pvert::attributeDescriptions(0);
     
-    VkPipelineVertexInputStateCreateInfo vinCreateInfo{};
-    vinCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vinCreateInfo.vertexBindingDescriptionCount = 1;
-    vinCreateInfo.pVertexBindingDescriptions = &bindDesc;
-    vinCreateInfo.vertexAttributeDescriptionCount = attrDesc.size();
-    vinCreateInfo.pVertexAttributeDescriptions = attrDesc.data();
-
-    VkPipelineInputAssemblyStateCreateInfo inAsmCreateInfo{};
-    inAsmCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    inAsmCreateInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    inAsmCreateInfo.primitiveRestartEnable = VK_FALSE;
-
-    VkViewport viewport{};
-    viewport.x = 0.0f;
-    viewport.y = swapExtent.height;
-    viewport.width = swapExtent.width;
-    // Vulkan says -Y is up, not down, flip so we're compatible with OpenGL code and obj models
-    viewport.height = -1.0f * swapExtent.height;
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-
-    VkRect2D scissor{};
-    scissor.offset = {0, 0};
-    scissor.extent = swapExtent;
-
-    VkPipelineViewportStateCreateInfo viewCreateInfo{};
-    viewCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    viewCreateInfo.viewportCount = 1;
-    viewCreateInfo.pViewports = &viewport;
-    viewCreateInfo.scissorCount = 1;
-    viewCreateInfo.pScissors = &scissor;
+        VkPipelineVertexInputStateCreateInfo vinCreateInfo{};
+        vinCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        vinCreateInfo.vertexBindingDescriptionCount = 1;
+        vinCreateInfo.pVertexBindingDescriptions = &bindDesc;
+        vinCreateInfo.vertexAttributeDescriptionCount = attrDesc.size();
+        vinCreateInfo.pVertexAttributeDescriptions = attrDesc.data();
+
+        VkPipelineInputAssemblyStateCreateInfo inAsmCreateInfo{};
+        inAsmCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inAsmCreateInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        inAsmCreateInfo.primitiveRestartEnable = VK_FALSE;
+
+        // the viewport and scissor are dynamic, so a resize doesn't need new pipelines. see recordThings
+        VkPipelineViewportStateCreateInfo viewCreateInfo{};
+        viewCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewCreateInfo.viewportCount = 1;
+        viewCreateInfo.scissorCount = 1;
     
-    VkPipelineRasterizationStateCreateInfo rasterCreateInfo{};
-    rasterCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    rasterCreateInfo.depthClampEnable = VK_FALSE; // clamps depth to range instead of discarding it
-    rasterCreateInfo.rasterizerDiscardEnable = VK_FALSE; // disables rasterization if true
-    rasterCreateInfo.polygonMode = VK_POLYGON_MODE_FILL;
-    rasterCreateInfo.cullMode = VK_CULL_MODE_BACK_BIT;
-    rasterCreateInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE; // flip cull order due to inverting y in rasterizer
-    rasterCreateInfo.depthBiasEnable = VK_FALSE;
-    rasterCreateInfo.lineWidth = 1.0f;
-
-    VkPipelineMultisampleStateCreateInfo msCreateInfo{};
-    msCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    msCreateInfo.sampleShadingEnable = VK_FALSE;
-    msCreateInfo.rasterizationSamples = msaaSamples;
-
-    VkPipelineDepthStencilStateCreateInfo dCreateInfo{};
-    dCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-    dCreateInfo.depthTestEnable = VK_TRUE;
-    dCreateInfo.depthWriteEnable = VK_TRUE;
-    dCreateInfo.depthCompareOp = VK_COMPARE_OP_LESS;
-    dCreateInfo.depthBoundsTestEnable = VK_FALSE;
-    dCreateInfo.stencilTestEnable = VK_FALSE;
-
-    VkPipelineColorBlendAttachmentState colorAttachment{}; // blending information per fb
-    colorAttachment.blendEnable = VK_FALSE;
-    colorAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | 
-                                        VK_COLOR_COMPONENT_G_BIT | 
-                                        VK_COLOR_COMPONENT_B_BIT |
-                                        VK_COLOR_COMPONENT_A_BIT;
-
-    VkPipelineColorBlendStateCreateInfo colorCreateInfo{};
-    colorCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    colorCreateInfo.logicOpEnable = VK_FALSE;
-    colorCreateInfo.attachmentCount = 1;
-    colorCreateInfo.pAttachments = &colorAttachment;
+        VkPipelineRasterizationStateCreateInfo rasterCreateInfo{};
+        rasterCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterCreateInfo.depthClampEnable = VK_FALSE; // clamps depth to range instead of discarding it
+        rasterCreateInfo.rasterizerDiscardEnable = VK_FALSE; // disables rasterization if true
+        rasterCreateInfo.polygonMode = VK_POLYGON_MODE_FILL;
+        rasterCreateInfo.cullMode = VK_CULL_MODE_BACK_BIT;
+        rasterCreateInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE; // flip cull order due to inverting y in rasterizer
+        rasterCreateInfo.depthBiasEnable = VK_FALSE;
+        rasterCreateInfo.lineWidth = 1.0f;
+
+        VkPipelineMultisampleStateCreateInfo msCreateInfo{};
+        msCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        msCreateInfo.sampleShadingEnable = VK_FALSE;
+        msCreateInfo.rasterizationSamples = samples;
+
+        VkPipelineDepthStencilStateCreateInfo dCreateInfo{};
+        dCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        dCreateInfo.depthTestEnable = VK_TRUE;
+        dCreateInfo.depthWriteEnable = VK_TRUE;
+        dCreateInfo.depthCompareOp = VK_COMPARE_OP_LESS;
+        dCreateInfo.depthBoundsTestEnable = VK_FALSE;
+        dCreateInfo.stencilTestEnable = VK_FALSE;
+
+        VkPipelineColorBlendAttachmentState colorAttachment{}; // blending information per fb
+        colorAttachment.blendEnable = VK_FALSE;
+        colorAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | 
+                                            VK_COLOR_COMPONENT_G_BIT | 
+                                            VK_COLOR_COMPONENT_B_BIT |
+                                            VK_COLOR_COMPONENT_A_BIT;
+
+        VkPipelineColorBlendStateCreateInfo colorCreateInfo{};
+        colorCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        colorCreateInfo.logicOpEnable = VK_FALSE;
+        colorCreateInfo.attachmentCount = 1;
+        colorCreateInfo.pAttachments = &colorAttachment;
     
-    VkPipelineDynamicStateCreateInfo dynCreateInfo{};
-    dynCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-    dynCreateInfo.dynamicStateCount = 0;
-
-    std::array<VkPushConstantRange, 1> pcr{};
-
-    // camera position
-    pcr[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-    pcr[0].offset = 0;
-    pcr[0].size = sizeof(glm::vec3);
-
-    VkPipelineLayoutCreateInfo pipeLayoutCreateInfo{}; // for descriptor sets
-    pipeLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipeLayoutCreateInfo.setLayoutCount = 1;
-    pipeLayoutCreateInfo.pSetLayouts = &t.layout;
-    pipeLayoutCreateInfo.pushConstantRangeCount = pcr.size();
-    pipeLayoutCreateInfo.pPushConstantRanges = pcr.data();
-
-    if (vkCreatePipelineLayout(dev, &pipeLayoutCreateInfo, nullptr, &t.pipeLayout) != VK_SUCCESS) {
-        throw std::runtime_error("cannot create obj pipeline layout!");
-    }
+        std::array<VkDynamicState, 2> dynStates = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
 
-    pipeLayoutCreateInfo.pSetLayouts = &flr.layout;
-    
-    if (vkCreatePipelineLayout(dev, &pipeLayoutCreateInfo, nullptr, &flr.pipeLayout) != VK_SUCCESS) {
-        throw std::runtime_error("cannot create flr pipeline layout!");
-    }
+        VkPipelineDynamicStateCreateInfo dynCreateInfo{};
+        dynCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+        dynCreateInfo.dynamicStateCount = dynStates.size();
+        dynCreateInfo.pDynamicStates = dynStates.data();
 
-    std::array<VkGraphicsPipelineCreateInfo, 2> pipeCreateInfos = {};
-    std::array<VkPipeline, 2> pipes;
+        std::array<VkGraphicsPipelineCreateInfo, 2> pipeCreateInfos = {};
+        std::array<VkPipeline, 2> pipes;
 
-    pipeCreateInfos[0].sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipeCreateInfos[0].sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
     
-    if (options::shaderDebug) {
-        pipeCreateInfos[0].flags = VK_PIPELINE_CREATE_CAPTURE_STATISTICS_BIT_KHR;
-    }
+        if (options::shaderDebug) {
+            pipeCreateInfos[0].flags = VK_PIPELINE_CREATE_CAPTURE_STATISTICS_BIT_KHR;
+        }
     
-    // (no major speedup expected from pipeline derivatives)
-    pipeCreateInfos[0].stageCount = shaders.size();
-    pipeCreateInfos[0].pStages = shaders.data();
-    pipeCreateInfos[0].pVertexInputState = &vinCreateInfo;
-    pipeCreateInfos[0].pInputAssemblyState = &inAsmCreateInfo;
-    pipeCreateInfos[0].pViewportState = &viewCreateInfo;
-    pipeCreateInfos[0].pRasterizationState = &rasterCreateInfo;
-    pipeCreateInfos[0].pMultisampleState = &msCreateInfo;
-    pipeCreateInfos[0].pDepthStencilState = &dCreateInfo;
-    pipeCreateInfos[0].pColorBlendState = &colorCreateInfo;
-    pipeCreateInfos[0].layout = t.pipeLayout; // handle, not a struct.
-    pipeCreateInfos[0].renderPass = renderPass;
-    pipeCreateInfos[0].subpass = 0;
-
-    pipeCreateInfos[1] = pipeCreateInfos[0];
+        // (no major speedup expected from pipeline derivatives)
+        pipeCreateInfos[0].stageCount = shaders.size();
+        pipeCreateInfos[0].pStages = shaders.data();
+        pipeCreateInfos[0].pVertexInputState = &vinCreateInfo;
+        pipeCreateInfos[0].pInputAssemblyState = &inAsmCreateInfo;
+        pipeCreateInfos[0].pViewportState = &viewCreateInfo;
+        pipeCreateInfos[0].pRasterizationState = &rasterCreateInfo;
+        pipeCreateInfos[0].pMultisampleState = &msCreateInfo;
+        pipeCreateInfos[0].pDepthStencilState = &dCreateInfo;
+        pipeCreateInfos[0].pColorBlendState = &colorCreateInfo;
+        pipeCreateInfos[0].pDynamicState = &dynCreateInfo;
+        pipeCreateInfos[0].layout = t.pipeLayout; // handle, not a struct.
+        pipeCreateInfos[0].renderPass = pass;
+        pipeCreateInfos[0].subpass = 0;
+
+        pipeCreateInfos[1] = pipeCreateInfos[0];
     
-    if (vkCreateGraphicsPipelines(dev, VK_NULL_HANDLE, things.size(), pipeCreateInfos.data(), nullptr, pipes.data()) != VK_SUCCESS) {
-        throw std::runtime_error("cannot create graphics pipeline!");
-    }
+        VkResult r = buildPipelines(things.size(), pipeCreateInfos.data(), pipes.data());
+        vkDestroyShaderModule(dev, vmod, nullptr); // we can destroy shader modules once the graphics pipeline is created.
+        vkDestroyShaderModule(dev, fmod, nullptr);
 
-    for (size_t i = 0; i < things.size(); i++) {
-        things[i].pipe = pipes[i];
-    }
+        if (r != VK_SUCCESS) {
+            throw std::runtime_error("cannot create graphics pipeline!");
+        }
 
-    if (options::shaderDebug && !printed) {
-        for (thing& t : things) {
-            printShaderStats(t);
+        for (size_t i = 0; i < things.size(); i++) {
+            things[i].pipe = pipes[i]; // nothing reads these until waitPipelines()
         }
-        printed = true; // prevent stats from being printed again if we recreate the pipeline
-    }
-    
-    vkDestroyShaderModule(dev, vmod, nullptr); // we can destroy shader modules once the graphics pipeline is created.
-    vkDestroyShaderModule(dev, fmod, nullptr);
+
+        if (options::shaderDebug && !printed) {
+            for (thing& t : things) {
+                printShaderStats(t);
+            }
+            printed = true; // prevent stats from being printed again if we recreate the pipeline
+        }
+    });
 }
 
 void appvk::createFramebuffers() {
@@ -295,63 +316,24 @@ void appvk::createFramebuffers() {
             throw std::runtime_error("cannot create framebuffer!");
         }
     }
-}
-
-appvk::buffer appvk::createVertexBuffer(const std::vector<uint8_t>& verts) {
-    VkDeviceSize bufferSize = verts.size();
-    buffer staging = createBuffer(verts.size(), 
-        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-    
-    buffer local = createBuffer(verts.size(), 
-        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, 
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-    void *data;
-    vkMapMemory(dev, staging.mem, 0, bufferSize, 0, &data);
-    memcpy(data, verts.data(), bufferSize);
-    vkUnmapMemory(dev, staging.mem);
-
-    copyBuffer(staging.buf, local.buf, bufferSize);
-
-    vkFreeMemory(dev, staging.mem, nullptr);
-    vkDestroyBuffer(dev, staging.buf, nullptr);
-
-    return local;
-}
-
-// wrapper for raw createVertexBuffer that takes a vloader mesh
-appvk::buffer appvk::createVertexBuffer(std::vector<vformat::vertex>& v) {
-    auto bytePtr = reinterpret_cast<uint8_t*>(v.data());
-	std::vector<uint8_t> byteData(bytePtr, bytePtr + v.size() * sizeof(vformat::vertex));
-
-    return createVertexBuffer(byteData);
-}
 
-appvk::buffer appvk::createIndexBuffer(const std::vector<uint32_t>& indices) {
-    VkDeviceSize bufferSize = indices.size() * sizeof(uint32_t);
+    VkImageView earlyAttachments[] = {ms.view, depth.view};
 
-    buffer staging = createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
-    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    VkFramebufferCreateInfo fCreateInfo{};
+    fCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    fCreateInfo.renderPass = earlyPass;
+    fCreateInfo.attachmentCount = 2;
+    fCreateInfo.pAttachments = earlyAttachments;
+    fCreateInfo.width = swapExtent.width;
+    fCreateInfo.height = swapExtent.height;
+    fCreateInfo.layers = 1;
 
-    buffer local = createBuffer(bufferSize,
-    VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-    void *data;
-    vkMapMemory(dev, staging.mem, 0, bufferSize, 0, &data);
-    memcpy(data, indices.data(), bufferSize);
-    vkUnmapMemory(dev, staging.mem);
-
-    copyBuffer(staging.buf, local.buf, bufferSize);
-
-    vkFreeMemory(dev, staging.mem, nullptr);
-    vkDestroyBuffer(dev, staging.buf, nullptr);
-
-    return local;
+    if (vkCreateFramebuffer(dev, &fCreateInfo, nullptr, &earlyFramebuffer) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create early framebuffer!");
+    }
 }
 
-appvk::texture appvk::createTextureImage(int width, int height, const unsigned char* data, bool makeMips) {
+appvk::texture appvk::createTextureImage(uploadBatch& b, int width, int height, const unsigned char* data, bool makeMips) {
 
     unsigned int mipLevels;
     if (makeMips) {
@@ -362,50 +344,32 @@ appvk::texture appvk::createTextureImage(int width, int height, const unsigned c
     
     VkDeviceSize imageSize = width * height * 4;
 
-    buffer staging = createBuffer(imageSize, 
-        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-    void *map_data;
-    vkMapMemory(dev, staging.mem, 0, imageSize, 0, &map_data);
-    memcpy(map_data, data, imageSize);
-    vkUnmapMemory(dev, staging.mem);
+    stagingSlice staging = stageUpload(b, data, imageSize);
 
     // used as a src when blitting to make mipmaps
     texture t = {createImage(width, height, VK_FORMAT_R8G8B8A8_SRGB, mipLevels, VK_SAMPLE_COUNT_1_BIT,
         VK_IMAGE_TILING_OPTIMAL,
         VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
         VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)};
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vmem::category::texture)};
     
-    transitionImageLayout(t, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-    copyBufferToImage(staging.buf, t.im, uint32_t(width), uint32_t(height));
-
-    vkFreeMemory(dev, staging.mem, nullptr);
-    vkDestroyBuffer(dev, staging.buf, nullptr);
+    transitionImageLayout(b.cbuf, t, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    copyBufferToImage(b.cbuf, staging.buf, t.im, uint32_t(width), uint32_t(height), staging.offset);
+    handOverImage(b, t);
 
-    generateMipmaps(t.im, VK_FORMAT_R8G8B8A8_SRGB, width, height, mipLevels);
+    // blits need a graphics queue
+    generateMipmaps(b.gfx, t.im, VK_FORMAT_R8G8B8A8_SRGB, width, height, mipLevels);
 
     return t;
 }
 
-void appvk::createDepthImage() {
-    depth = createImage(swapExtent.width, swapExtent.height,
-        depthFormat, 1, msaaSamples,
-        VK_IMAGE_TILING_OPTIMAL,
-        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    
-    transitionImageLayout(depth, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
-    
-    depth.view = createImageView(depth.im, depthFormat, 1, VK_IMAGE_ASPECT_DEPTH_BIT);
-}
-
-void appvk::createMultisampleImage() {
-    ms = createImage(swapExtent.width, swapExtent.height, swapFormat, 1, msaaSamples, 
-    VK_IMAGE_TILING_OPTIMAL,
-    VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
-    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+// msaa color and depth carry over from earlyPass to renderPass, and the depth pyramid is built from depth in between
+void appvk::createAttachments() {
+    // both are used by both passes, so they can't share memory with each other
+    std::vector<transientAttachment> attachments = {
+        {&ms, swapFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, true},
+        {&depth, depthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, true},
+    };
 
-    ms.view = createImageView(ms.im, swapFormat, 1, VK_IMAGE_ASPECT_COLOR_BIT);
+    createTransientAttachments(attachments);
 }
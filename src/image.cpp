@@ -45,10 +45,8 @@ VkFormat appvk::findImageFormat(const std::vector<VkFormat>& formats, VkImageTil
     return VK_FORMAT_UNDEFINED;
 }
 
-// transition miplevels of image from the oldl layout to the newl layout
-void appvk::transitionImageLayout(image im, VkImageLayout oldl, VkImageLayout newl) {
-    VkCommandBuffer buf = beginSingleCommand();
-
+// record a transition of all miplevels of image from the oldl layout to the newl layout
+void appvk::transitionImageLayout(VkCommandBuffer buf, image im, VkImageLayout oldl, VkImageLayout newl) {
     VkImageSubresourceRange range{};
 
     if (newl == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
@@ -98,13 +96,9 @@ void appvk::transitionImageLayout(image im, VkImageLayout oldl, VkImageLayout ne
     }
 
     vkCmdPipelineBarrier(buf, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
-
-    endSingleCommand(buf);
 }
 
-void appvk::copyBufferToImage(VkBuffer buf, VkImage img, uint32_t width, uint32_t height) {
-    VkCommandBuffer cbuf = beginSingleCommand();
-
+void appvk::copyBufferToImage(VkCommandBuffer cbuf, VkBuffer buf, VkImage img, uint32_t width, uint32_t height, VkDeviceSize offset) {
     VkImageSubresourceLayers rec{};
     rec.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     rec.mipLevel = 0;
@@ -112,18 +106,16 @@ void appvk::copyBufferToImage(VkBuffer buf, VkImage img, uint32_t width, uint32_
     rec.layerCount = 1;
 
     VkBufferImageCopy copy{};
-    copy.bufferOffset = 0;
+    copy.bufferOffset = offset;
     copy.imageSubresource = rec;
     copy.imageOffset = {0, 0, 0};
     copy.imageExtent = {width, height, 1};
 
     vkCmdCopyBufferToImage(cbuf, buf, img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
-
-    endSingleCommand(cbuf);
 }
 
 appvk::image appvk::createImage(unsigned int width, unsigned int height, VkFormat format, unsigned int mipLevels,
-    VkSampleCountFlagBits samples, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags props) {
+    VkSampleCountFlagBits samples, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags props, vmem::category cat) {
     VkImageCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     createInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -145,16 +137,9 @@ appvk::image appvk::createImage(unsigned int width, unsigned int height, VkForma
     VkMemoryRequirements memReq;
     vkGetImageMemoryRequirements(dev, im.im, &memReq);
 
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memReq.size;
-    allocInfo.memoryTypeIndex = findMemoryType(memReq.memoryTypeBits, props);
+    im.mem = allocator.alloc(memReq, {props, 0, vmem::usage::gpuOnly, cat}, tiling == VK_IMAGE_TILING_LINEAR);
 
-    if (vkAllocateMemory(dev, &allocInfo, nullptr, &(im.mem)) != VK_SUCCESS) {
-        throw std::runtime_error("cannot allocate texture memory!");
-    }
-
-    vkBindImageMemory(dev, im.im, im.mem, 0);
+    vkBindImageMemory(dev, im.im, im.mem.mem, im.mem.offset);
 
     im.mipLevels = mipLevels;
 
@@ -184,9 +169,7 @@ VkSampler appvk::createSampler(unsigned int mipLevels) {
     return samp;
 }
 
-void appvk::generateMipmaps(VkImage image, VkFormat format, unsigned int width, unsigned int height, unsigned int levels) {
-    VkCommandBuffer b = beginSingleCommand();
-
+void appvk::generateMipmaps(VkCommandBuffer b, VkImage image, VkFormat format, unsigned int width, unsigned int height, unsigned int levels) {
     VkFormatProperties prop;
     vkGetPhysicalDeviceFormatProperties(pdev, format, &prop);
     if (!(prop.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_SRC_BIT) || !(prop.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT)) {
@@ -262,6 +245,4 @@ void appvk::generateMipmaps(VkImage image, VkFormat format, unsigned int width,
     vkCmdPipelineBarrier(b,
     VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
     0, 0, nullptr, 0, nullptr, 1, &mipBarrier);
-
-    endSingleCommand(b);
 }
\ No newline at end of file
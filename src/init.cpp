@@ -23,6 +23,21 @@ bool appvk::checkDeviceExtensions(VkPhysicalDevice pdev) {
     return tempExtensionList.empty();
 }
 
+bool appvk::hasDeviceExtension(VkPhysicalDevice pdev, std::string_view name) {
+    uint32_t numExtensions;
+    vkEnumerateDeviceExtensionProperties(pdev, nullptr, &numExtensions, nullptr);
+    std::vector<VkExtensionProperties> deviceExtensions(numExtensions);
+    vkEnumerateDeviceExtensionProperties(pdev, nullptr, &numExtensions, deviceExtensions.data());
+
+    for (const auto& extension : deviceExtensions) {
+        if (name == extension.extensionName) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 VkSampleCountFlagBits appvk::getSamples(unsigned int try_samples) {
     VkPhysicalDeviceProperties dprop;
     vkGetPhysicalDeviceProperties(pdev, &dprop);
@@ -142,7 +157,11 @@ void appvk::createLogicalDevice() {
         chosenComputeFamily = *(qi.compute);
     }
 
-    VkDeviceQueueCreateInfo queueInfos[2] = {};
+    // a transfer-only family is usually the copy engine, which can stream data in without stalling graphics work
+    bool dedicatedTransfer = qi.onlyTransfer.has_value();
+    uint32_t chosenTransferFamily = dedicatedTransfer ? *(qi.onlyTransfer) : *(qi.graphics);
+
+    VkDeviceQueueCreateInfo queueInfos[3] = {};
     queueInfos[0].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
     queueInfos[0].queueFamilyIndex = *(qi.graphics);
     queueInfos[0].queueCount = 1;
@@ -154,9 +173,40 @@ void appvk::createLogicalDevice() {
     queueInfos[1].queueCount = 1;
     queueInfos[1].pQueuePriorities = &pri; // highest priority
 
+    queueInfos[2].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queueInfos[2].queueFamilyIndex = chosenTransferFamily;
+    queueInfos[2].queueCount = 1;
+    queueInfos[2].pQueuePriorities = &pri;
+
+    VkPhysicalDeviceVulkan12Features supported12{};
+    supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_12_FEATURES;
+
+    VkPhysicalDeviceFeatures2 supported{};
+    supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supported.pNext = &supported12;
+    vkGetPhysicalDeviceFeatures2(pdev, &supported);
+
+    // culled draws pass the instance index through firstInstance
+    if (!supported.features.drawIndirectFirstInstance) {
+        throw std::runtime_error("cannot draw indirect with a first instance!");
+    }
+
+    // optional, culling falls back to keeping culled draws in place with no instances
+    drawIndirectCount = supported12.drawIndirectCount;
+    multiDrawIndirect = supported.features.multiDrawIndirect;
+    hostQueryReset = supported12.hostQueryReset; // optional, lets the profiler time queues that can't reset queries
+
+    // needed for the upload timeline
+    VkPhysicalDeviceVulkan12Features feat12{};
+    feat12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_12_FEATURES;
+    feat12.timelineSemaphore = VK_TRUE;
+    feat12.drawIndirectCount = drawIndirectCount;
+    feat12.hostQueryReset = hostQueryReset;
+
     VkPhysicalDevicePipelineExecutablePropertiesFeaturesKHR execProp{};
     execProp.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PIPELINE_EXECUTABLE_PROPERTIES_FEATURES_KHR;
     execProp.pipelineExecutableInfo = VK_TRUE;
+    execProp.pNext = &feat12;
 
     // this structure is the same as deviceFeatures but has a pNext member too
     VkPhysicalDeviceFeatures2 feat2{};
@@ -164,15 +214,25 @@ void appvk::createLogicalDevice() {
     feat2.pNext = &execProp;
     feat2.features = {}; // set everything not used to zero
     feat2.features.samplerAnisotropy = VK_TRUE;
+    feat2.features.drawIndirectFirstInstance = VK_TRUE;
+    feat2.features.multiDrawIndirect = multiDrawIndirect;
 
     VkDeviceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
     createInfo.pNext = &feat2;
     createInfo.pQueueCreateInfos = queueInfos;
-    createInfo.queueCreateInfoCount = 2;
+    createInfo.queueCreateInfoCount = dedicatedTransfer ? 3 : 2;
     createInfo.pEnabledFeatures = nullptr;
-    createInfo.enabledExtensionCount = requiredExtensions.size();
-    createInfo.ppEnabledExtensionNames = requiredExtensions.data();
+    std::vector<const char*> extensions(requiredExtensions.begin(), requiredExtensions.end());
+
+    // optional, lets the allocator see how much memory it can actually use
+    memoryBudget = hasDeviceExtension(pdev, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    if (memoryBudget) {
+        extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    }
+
+    createInfo.enabledExtensionCount = extensions.size();
+    createInfo.ppEnabledExtensionNames = extensions.data();
             
     if (vkCreateDevice(pdev, &createInfo, nullptr, &dev)) {
         throw std::runtime_error("cannot create virtual device!");
@@ -180,7 +240,9 @@ void appvk::createLogicalDevice() {
 
     vkGetDeviceQueue(dev, *(qi.graphics), 0, &gQueue); // creating a device also creates queues for it
     vkGetDeviceQueue(dev, chosenComputeFamily, 0, &cQueue);
+    vkGetDeviceQueue(dev, chosenTransferFamily, 0, &tQueue); // falls back to the graphics queue
 
     gQueueFamily = *(qi.graphics);
     cQueueFamily = chosenComputeFamily;
+    tQueueFamily = chosenTransferFamily;
 }
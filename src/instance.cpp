@@ -0,0 +1,97 @@
+#include "main.hpp"
+
+#include <algorithm>
+
+#include "options.hpp"
+
+void appvk::createInstanceBuffer(uint32_t capacity) {
+    VkPhysicalDeviceProperties dprop;
+    vkGetPhysicalDeviceProperties(pdev, &dprop);
+    VkDeviceSize align = dprop.limits.minStorageBufferOffsetAlignment;
+
+    instances.capacity = capacity;
+    instances.regionSize = (capacity * sizeof(instanceData) + align - 1) / align * align;
+
+    instances.buf = createBuffer(instances.regionSize * options::maxFramesInFlight, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, vmem::usage::dynamic, vmem::category::uniform);
+
+    instances.data.reserve(capacity);
+    instances.dirty.assign(options::maxFramesInFlight, {0, 0});
+}
+
+void appvk::destroyInstanceBuffer() {
+    vkDestroyBuffer(dev, instances.buf.buf, nullptr);
+    allocator.free(instances.buf.mem);
+}
+
+// appends count instances for t, a thing's instances have to be added together so they stay contiguous
+void appvk::addInstances(thing& t, const std::vector<glm::mat4>& models) {
+    uint32_t batch = &t - things.data();
+
+    if (instances.data.size() + models.size() > instances.capacity) {
+        throw std::runtime_error("instance buffer is full!");
+    }
+
+    t.firstInstance = instances.data.size();
+    t.instanceCount = models.size();
+
+    for (const glm::mat4& m : models) {
+        instanceData in{};
+        in.model = m;
+        in.batch = batch;
+        instances.data.push_back(in);
+    }
+
+    markInstances(t.firstInstance, t.firstInstance + t.instanceCount);
+    sceneVersion++; // draw counts are recorded
+}
+
+void appvk::setInstance(uint32_t i, const glm::mat4& model) {
+    instances.data[i].model = model;
+    markInstances(i, i + 1);
+}
+
+void appvk::markInstances(uint32_t begin, uint32_t end) {
+    for (auto& [b, e] : instances.dirty) {
+        if (b == e) {
+            b = begin;
+            e = end;
+        } else {
+            b = std::min(b, begin);
+            e = std::max(e, end);
+        }
+    }
+}
+
+// copy whatever changed since frame's region was last written. the last frame to use that region is done.
+void appvk::flushInstances(uint32_t frame) {
+    auto& [begin, end] = instances.dirty[frame];
+    if (begin == end) {
+        return;
+    }
+
+    char* region = static_cast<char*>(instances.buf.mem.mapped) + frame * instances.regionSize;
+    memcpy(region + begin * sizeof(instanceData), instances.data.data() + begin, (end - begin) * sizeof(instanceData));
+
+    begin = end = 0;
+}
+
+void appvk::allocDescriptorSetInstances(thing& t) {
+    for (size_t i = 0; i < swapImages.size(); i++) {
+        VkDescriptorBufferInfo bufferInfo{};
+        bufferInfo.buffer = instances.buf.buf;
+        bufferInfo.offset = 0;
+        bufferInfo.range = instances.regionSize;
+
+        VkWriteDescriptorSet set{};
+        set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        set.dstSet = t.dsets[i];
+        set.dstBinding = 2;
+        set.dstArrayElement = 0;
+        set.descriptorCount = 1;
+        set.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+        set.pBufferInfo = &bufferInfo;
+
+        vkUpdateDescriptorSets(dev, 1, &set, 0, nullptr);
+    }
+}
@@ -3,62 +3,111 @@
 
 #include "vloader.hpp"
 #include "iloader.hpp"
+#include "mcache.hpp"
+#include "mopt.hpp"
 
 #include "options.hpp"
 
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+
 // config location from inside imgui folder
 #define IMGUI_USER_CONFIG "../src/imgui_cfg.hpp"
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_vulkan.h"
 
-void appvk::recreateSwapChain() {
-	vkDeviceWaitIdle(dev);
+// only what depends on the window's size is rebuilt. the render passes, and with them the graphics pipelines and
+// the ui backend, only depend on formats and are kept unless the surface format changes.
+// nothing waits for the gpu: the old swapchain is handed to the new one as oldSwapchain, and everything sized to it is
+// retired until the frames already in flight are done with it.
+bool appvk::recreateSwapChain() {
+	using clock = std::chrono::steady_clock;
+	auto ms = [](clock::time_point a, clock::time_point b) { return std::chrono::duration<float, std::milli>(b - a).count(); };
 
 	int width, height;
 	glfwGetFramebufferSize(w, &width, &height);
-	while (width == 0 || height == 0) { // wait until window isn't hidden anymore
-		glfwGetFramebufferSize(w, &width, &height);
-		glfwWaitEvents(); // put this thread to sleep until events exist
+	if (width == 0 || height == 0) {
+		glfwWaitEvents(); // minimised, sleep until something happens to the window and try again
+		return false;
 	}
 
+	auto start = clock::now();
+
+	VkFormat oldFormat = swapFormat;
+
 	cleanupSwapChain();
 
 	createSwapChain();
 	createSwapViews();
+	auto swapEnd = clock::now();
+
+	// rare enough that waiting is fine, the pipelines and the ui backend are rebuilt anyway
+	bool newPass = swapFormat != oldFormat;
+	float before = pipelineMs;
+	if (newPass) {
+		vkDeviceWaitIdle(dev);
+		cleanupRenderPass();
+		createRenderPass();
+		createGraphicsPipeline(); // builds while the attachments are made
+	}
 
-	createRenderPass();
-	createGraphicsPipeline();
-
-	createDepthImage();
-	createMultisampleImage();
+	createAttachments();
 	createFramebuffers();
-	createUniformBuffers();
-
-	createDescriptorPool();
+	createDepthPyramid();
+	auto attachEnd = clock::now();
 
-	for (thing& t : things) {
-		allocDescriptorSets(dPool, t);
-		allocDescriptorSetUniform(t);
+	if (newPass) {
+		initVulkanUI();
+		waitPipelines();
 	}
 
-	allocDescriptorSetTexture(t, t.diff, 0);
-	allocDescriptorSetTexture(t, t.norm, 1);
-	allocDescriptorSetTexture(t, t.disp, 2);
+	sceneVersion++; // the recorded draws set the old viewport
 
-	allocDescriptorSetTexture(flr, flr.diff, 0);
-	allocDescriptorSetTexture(flr, flr.norm, 1);
-	allocDescriptorSetTexture(flr, flr.disp, 2);
-
-	allocRenderCmdBuffers();
+	auto end = clock::now();
+	if constexpr (options::verbose) {
+		cout << "resized to " << swapExtent.width << "x" << swapExtent.height << " in " << ms(start, end) << " ms: swapchain "
+			<< ms(start, swapEnd) << " ms, attachments " << ms(swapEnd, attachEnd) << " ms, rest " << ms(attachEnd, end) << " ms";
+		if (newPass) {
+			cout << " (new surface format, rebuilt render passes and " << pipelineMs - before << " ms of pipelines)";
+		}
+		cout << ", " << retired.size() << " objects waiting on frames in flight\n";
+	}
 
-	createSyncs();
+	return true;
+}
 
-	ImGui_ImplVulkan_Shutdown();
-	initVulkanUI();
+// --present <fifo|fifo_relaxed|mailbox|immediate> and --frames <1 to options::maxFramesInFlight>
+void appvk::parseArgs(int argc, char** argv) {
+	for (int i = 1; i < argc; i++) {
+		std::string_view arg = argv[i];
+
+		if (arg == "--present" && i + 1 < argc) {
+			std::optional<VkPresentModeKHR> mode = parsePresentMode(argv[++i]);
+			if (mode) {
+				wantedPresentMode = *mode;
+			} else {
+				cerr << "unknown present mode " << argv[i] << ", expected fifo, fifo_relaxed, mailbox or immediate\n";
+			}
+		} else if (arg == "--frames" && i + 1 < argc) {
+			int frames = std::atoi(argv[++i]);
+			if (frames >= 1 && frames <= int(options::maxFramesInFlight)) {
+				wantedFramesInFlight = frames;
+			} else {
+				cerr << "frames in flight has to be between 1 and " << options::maxFramesInFlight << "\n";
+			}
+		} else {
+			cerr << "ignoring argument " << arg << "\n";
+		}
+	}
 }
 
-appvk::appvk() : basevk(false), c(0.0f, 0.0f, -3.0f) {
+appvk::appvk(int argc, char** argv) : basevk(false), c(0.0f, 0.0f, -3.0f) {
+
+	wantedFramesInFlight = options::framesInFlight;
+	parseArgs(argc, argv);
+	framesInFlight = wantedFramesInFlight; // per frame resources are sized for options::maxFramesInFlight regardless
 
 	IMGUI_CHECKVERSION(); // make sure imgui is set up properly
 	ImGui::CreateContext();
@@ -70,13 +119,22 @@ appvk::appvk() : basevk(false), c(0.0f, 0.0f, -3.0f) {
 	// disable and center cursor
 	// glfwSetInputMode(w, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
+	// models only go through assimp if there's no up to date binary cache for them
 	constexpr std::string_view objstr = "models/sphere.obj";
-	vload::vloader obj(objstr, true, true, true);
-	obj.dispatch();
+	mcache::file objCache;
+	std::optional<vload::vloader> obj;
+	if (!objCache.open(objstr)) {
+		obj.emplace(objstr, true, true, true);
+		obj->dispatch();
+	}
 
 	constexpr std::string_view fstr = "models/cube.obj";
-	vload::vloader f(fstr, true, true, true);
-	f.dispatch();
+	mcache::file fCache;
+	std::optional<vload::vloader> f;
+	if (!fCache.open(fstr)) {
+		f.emplace(fstr, true, true, true);
+		f->dispatch();
+	}
 
 	std::array<iload::iloader, 6> loaders = {
 		iload::iloader("textures/grass/diffuse.jpg", false),
@@ -95,12 +153,18 @@ appvk::appvk() : basevk(false), c(0.0f, 0.0f, -3.0f) {
 	createSurface();
 	pickPhysicalDevice(any);
 	createLogicalDevice();
+	allocator.create(pdev, dev, memoryBudget);
+	createPipelineCache();
+	createProfiler();
+	allocator.setEvictCallback([this](VkDeviceSize) { return trimStagingArena(); }); // staging is the only thing we can drop
+
+	// pipelines are kicked off as soon as their layouts exist and compile while the rest of setup and the model and
+	// texture loads run. nothing binds them until waitPipelines() near the end.
+	buildPool.emplace(std::max(2u, std::thread::hardware_concurrency()) - 1); // hardware_concurrency may be 0
 
 	createComputeBuffers();
 	createComputeDescriptors();
 	createComputePipeline();
-	VkCommandBuffer buf = createComputeCommandBuffer();
-	runCompute(buf);
 
 	createSwapChain();
 	createSwapViews();
@@ -114,29 +178,81 @@ appvk::appvk() : basevk(false), c(0.0f, 0.0f, -3.0f) {
 	createGraphicsPipeline();
 
 	createCommandPool();
-	createDepthImage();
-	createMultisampleImage();
+	createAttachments();
 	createFramebuffers();
 
-	createUniformBuffers();
+	createUniformRing();
+	createInstanceBuffer(options::instanceCapacity);
 	createDescriptorPool();
 
+	// the object is instance 0 and spins, a grid of static copies surrounds it
+	std::vector<glm::mat4> copies = {glm::mat4(1.0f)};
+	for (int x = 0; x < int(options::instanceGrid); x++) {
+		for (int z = 0; z < int(options::instanceGrid); z++) {
+			glm::vec3 offset(x - int(options::instanceGrid) / 2, 0.0f, z - int(options::instanceGrid) / 2);
+			if (offset != glm::vec3(0.0f)) {
+				copies.push_back(glm::translate(glm::mat4(1.0f), offset * options::instanceSpacing));
+			}
+		}
+	}
+
+	addInstances(t, copies);
+	addInstances(flr, {glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -1.0f, 0.0f))});
+
 	for (thing& t : things) {
 		allocDescriptorSets(dPool, t);
 		allocDescriptorSetUniform(t);
+		allocDescriptorSetInstances(t);
 	}
 
-	obj.join();
-	t.vert = createVertexBuffer(obj.meshList[0].verts);
-	t.index = createIndexBuffer(obj.meshList[0].indices);
-	cout << "loaded model " << objstr << "\n";
-	t.indices = obj.meshList[0].indices.size();
+	// neither needs the meshes, so their pipelines can build during the uploads
+	createCullPass();
+	createPyramidPipeline();
+
+	// every mesh and texture upload goes into one batch, so there is a single submit instead of a queue stall per copy.
+	// the copies run on the transfer queue when there is one.
+	createUploadTimeline();
+	createStagingArena();
+	createMeshPool(options::meshVertexBytes, options::meshIndexBytes);
+	uploadBatch upload = beginUpload(true);
+
+	auto uploadModel = [&](std::string_view path, std::optional<vload::vloader>& ld, const mcache::file& cached) {
+		uint32_t id;
+		if (cached.valid()) {
+			id = uploadMesh(upload, cached.get());
+			cout << "loaded model " << path << " from cache\n";
+		} else {
+			ld->join();
+			auto& m = ld->meshList[0];
+
+			// optimised and simplified once here, the cache stores the result
+			mopt::report r = mopt::optimize(m.verts, m.indices);
+			cout << "optimised " << path << ": acmr " << r.before.acmr << " -> " << r.after.acmr
+				<< ", atvr " << r.before.atvr << " -> " << r.after.atvr << "\n";
+
+			std::vector<mopt::level> levels = mopt::buildLods(m.verts, m.indices, pvert::maxLods);
+			std::vector<uint32_t> indices;
+			std::vector<pvert::lod> lods;
+			cout << "lods for " << path << ":";
+			for (const mopt::level& l : levels) {
+				lods.push_back({uint32_t(indices.size()), uint32_t(l.indices.size()), l.error});
+				indices.insert(indices.end(), l.indices.begin(), l.indices.end());
+				cout << " " << l.indices.size() / 3;
+			}
+			cout << " triangles\n";
+
+			pvert::packed p = pvert::pack(m.verts, indices, lods);
+			mcache::write(path, p);
+			id = uploadMesh(upload, p.get());
+			cout << "loaded model " << path << "\n";
+		}
+
+		return id;
+	};
 
-	f.join();
-	flr.vert = createVertexBuffer(f.meshList[0].verts);
-	flr.index = createIndexBuffer(f.meshList[0].indices);
-	cout << "loaded model " << fstr << "\n\n";
-	flr.indices = f.meshList[0].indices.size();
+	t.meshId = uploadModel(objstr, obj, objCache);
+	flr.meshId = uploadModel(fstr, f, fCache);
+	cout << "\n";
 
 	for (size_t i = 0; i < loaders.size(); i++) {
 		loaders[i].join();
@@ -145,7 +261,7 @@ appvk::appvk() : basevk(false), c(0.0f, 0.0f, -3.0f) {
 		thing& t = things[thing_idx];
 
 		size_t map_idx = i % 3;
-		t.maps[map_idx] = createTextureImage(loaders[i].width, loaders[i].height, loaders[i].data);
+		t.maps[map_idx] = createTextureImage(upload, loaders[i].width, loaders[i].height, loaders[i].data);
 		t.maps[map_idx].view = createImageView(t.maps[map_idx].im, VK_FORMAT_R8G8B8A8_SRGB, t.maps[map_idx].mipLevels, VK_IMAGE_ASPECT_COLOR_BIT);
 		t.maps[map_idx].samp = createSampler(t.maps[map_idx].mipLevels);
 
@@ -154,11 +270,31 @@ appvk::appvk() : basevk(false), c(0.0f, 0.0f, -3.0f) {
 		allocDescriptorSetTexture(t, t.maps[map_idx], thing_idx);
 	}
 
+	// nothing waits on this; drawFrame releases the staging memory once it finishes
+	submitUpload(upload);
+	uploads.push_back(upload);
+
+	writeDrawInfo();
+	createDepthPyramid();
+
 	allocRenderCmdBuffers();
+	createRecorders();
 
 	createSyncs();
 
 	initVulkanUI();
+
+	waitPipelines();
+
+	VkCommandBuffer buf = createComputeCommandBuffer();
+	runCompute(buf);
+
+	cout << "built " << pipelineCount << " pipelines in " << pipelineMs << " ms on " << buildPool->size()
+		<< " threads, waited " << pipelineWaitMs << " ms for them, "
+		<< (pipeCacheLoaded ? "warm" : "cold") << " pipeline cache (" << pipeCacheLoaded / 1024 << " KiB)\n";
+	cout << "present mode " << presentModeName(presentMode) << ", " << framesInFlight << " frames in flight\n";
+
+	startPacingWatcher();
 }
 
 void appvk::drawFrame() {
@@ -166,41 +302,67 @@ void appvk::drawFrame() {
 	// NOTE: acquiring an image, writing to it, and presenting it are all async operations.
 	// The relevant vulkan calls return before the operation completes.
 
-	// wait for a command buffer to finish writing to the current image
-	vkWaitForFences(dev, 1, &inFlightFences[currFrame], VK_FALSE, UINT64_MAX);
+	// anything changed in the overlay last frame, or on the command line
+	applyFrameSettings();
+
+	// wait for the frame that last used currFrame's command buffer, semaphores and ring regions
+	beginFrame();
 
 	uint32_t nextFrame;
 	VkResult r = vkAcquireNextImageKHR(dev, swap, UINT64_MAX, imageAvailSems[currFrame], VK_NULL_HANDLE, &nextFrame);
 	// NOTE: currFrame may not always be equal to nextFrame (there's no guarantee that nextFrame increases linearly)
 
-	if (r == VK_ERROR_OUT_OF_DATE_KHR || resizeOccurred) {
-		recreateSwapChain(); // have to recreate the swapchain here
-		resizeOccurred = false;
+	// a resize that still got an image is handled after presenting it, so the acquire's semaphore gets waited on
+	if (r == VK_ERROR_OUT_OF_DATE_KHR) {
+		resizeOccurred = !recreateSwapChain(); // have to recreate the swapchain here
 		return;
 	} else if (r != VK_SUCCESS && r != VK_SUBOPTIMAL_KHR) { // we can still technically run with a suboptimal swapchain
 		throw std::runtime_error("cannot acquire swapchain image!");
 	}
 
-	// wait for the previous frame to finish using the swapchain image at nextFrame
-	if (imagesInFlight[nextFrame] != VK_NULL_HANDLE) {
-		vkWaitForFences(dev, 1, &imagesInFlight[nextFrame], VK_FALSE, UINT64_MAX);
+	// nothing is kept per swapchain image, and the acquire semaphore covers the presentation engine, so there's no
+	// need to wait for the last frame that drew into nextFrame
+
+	// drop any finished uploads
+	for (size_t i = 0; i < uploads.size();) {
+		if (uploadDone(uploads[i])) {
+			uploads.erase(uploads.begin() + i);
+		} else {
+			i++;
+		}
 	}
 
-	imagesInFlight[nextFrame] = inFlightFences[currFrame]; // this frame is using the fence at currFrame
+	updateFrame();
 
-	updateFrame(nextFrame);
+	auto recordStart = std::chrono::steady_clock::now();
+
+	// the draws go into secondaries on the workers while this thread records the ui and the primary
+	recordSecondaries();
 
 	VkCommandBufferBeginInfo beginInfo{};
 	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-	if (vkBeginCommandBuffer(commandBuffers[nextFrame], &beginInfo) != VK_SUCCESS) {
+	if (vkBeginCommandBuffer(commandBuffers[currFrame], &beginInfo) != VK_SUCCESS) {
 		throw std::runtime_error("cannot begin recording command buffer!");
 	}
 
+	auto& cbuf = commandBuffers[currFrame];
+
+	beginProfilerFrame(cbuf);
+	beginScope(cbuf, "frame");
+
+	// while the workers are still busy. it runs in the late pass, and its scope says so
+	recordUi(nextFrame);
+
+	// early phase: whatever was visible last frame
+	beginScope(cbuf, "early cull");
+	recordCull(cbuf, 0);
+	endScope(cbuf);
+
 	VkRenderPassBeginInfo rBeginInfo{};
 	rBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-	rBeginInfo.renderPass = renderPass;
-	rBeginInfo.framebuffer = swapFramebuffers[nextFrame];
+	rBeginInfo.renderPass = earlyPass;
+	rBeginInfo.framebuffer = earlyFramebuffer;
 	rBeginInfo.renderArea.offset = { 0, 0 };
 	rBeginInfo.renderArea.extent = swapExtent;
 
@@ -211,34 +373,43 @@ void appvk::drawFrame() {
 	rBeginInfo.clearValueCount = attachClearValues.size();
 	rBeginInfo.pClearValues = attachClearValues.data();
 
-	auto& cbuf = commandBuffers[nextFrame];
-	
 	// commands here respect submission order, but draw command pipeline stages can go out of order
-	vkCmdBeginRenderPass(cbuf, &rBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-	
-		VkDeviceSize offset[] = { 0 };
+	beginScope(cbuf, "early pass");
+	vkCmdBeginRenderPass(cbuf, &rBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+		executeSecondaries(cbuf, 0);
+	vkCmdEndRenderPass(cbuf);
+	endScope(cbuf);
 
-		vkCmdBindPipeline(cbuf, VK_PIPELINE_BIND_POINT_GRAPHICS, t.pipe);
-		vkCmdBindVertexBuffers(cbuf, 0, 1, &t.vert.buf, offset);
-		vkCmdBindIndexBuffer(cbuf, t.index.buf, 0, VK_INDEX_TYPE_UINT32);
-		vkCmdBindDescriptorSets(cbuf, VK_PIPELINE_BIND_POINT_GRAPHICS, t.pipeLayout, 0, 1, &t.dsets[nextFrame], 0, nullptr);
-		vkCmdPushConstants(cbuf, t.pipeLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::vec3), &c.pos);
-		vkCmdDrawIndexed(cbuf, t.indices, 1, 0, 0, 0);
+	// late phase: test everything against what the early phase drew, draw what it missed
+	beginScope(cbuf, "depth pyramid");
+	recordPyramid(cbuf);
+	endScope(cbuf);
 
-		vkCmdBindPipeline(cbuf, VK_PIPELINE_BIND_POINT_GRAPHICS, flr.pipe);
-		vkCmdBindVertexBuffers(cbuf, 0, 1, &flr.vert.buf, offset);
-		vkCmdBindIndexBuffer(cbuf, flr.index.buf, 0, VK_INDEX_TYPE_UINT32);
-		vkCmdBindDescriptorSets(cbuf, VK_PIPELINE_BIND_POINT_GRAPHICS, flr.pipeLayout, 0, 1, &flr.dsets[nextFrame], 0, nullptr);
-		vkCmdDrawIndexed(cbuf, flr.indices, 1, 0, 0, 0);
+	beginScope(cbuf, "late cull");
+	recordCull(cbuf, 1);
+	endScope(cbuf);
 
-		ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), cbuf);
+	// nothing is cleared
+	rBeginInfo.renderPass = renderPass;
+	rBeginInfo.framebuffer = swapFramebuffers[nextFrame];
+	rBeginInfo.clearValueCount = 0;
+	rBeginInfo.pClearValues = nullptr;
 
+	// no timestamps can go between the secondaries in here, the ui times itself
+	beginScope(cbuf, "late pass");
+	vkCmdBeginRenderPass(cbuf, &rBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+		executeSecondaries(cbuf, 1);
 	vkCmdEndRenderPass(cbuf);
+	endScope(cbuf);
+
+	endScope(cbuf); // frame
 	
-	if (vkEndCommandBuffer(commandBuffers[nextFrame]) != VK_SUCCESS) {
+	if (vkEndCommandBuffer(commandBuffers[currFrame]) != VK_SUCCESS) {
 		throw std::runtime_error("cannot record into command buffer!");
 	}
 
+	recordMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - recordStart).count();
+
 	VkSubmitInfo si{};
 	si.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
@@ -251,13 +422,26 @@ void appvk::drawFrame() {
 	si.pWaitDstStageMask = waitStages;
 
 	si.commandBufferCount = 1;
-	si.pCommandBuffers = &commandBuffers[nextFrame];
+	si.pCommandBuffers = &commandBuffers[currFrame];
+
+	// the binary semaphore for presenting, and the frame's number on the timeline
+	std::array<VkSemaphore, 2> signals = {renderDoneSems[currFrame], frameTimeline};
+	std::array<uint64_t, 2> signalValues = {0, framesSubmitted + 1}; // binary semaphores ignore theirs
+
+	VkTimelineSemaphoreSubmitInfo timelineInfo{};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineInfo.signalSemaphoreValueCount = signalValues.size();
+	timelineInfo.pSignalSemaphoreValues = signalValues.data();
 
-	si.signalSemaphoreCount = 1;
-	si.pSignalSemaphores = &renderDoneSems[currFrame];
+	si.pNext = &timelineInfo;
+	si.signalSemaphoreCount = signals.size();
+	si.pSignalSemaphores = signals.data();
 
-	vkResetFences(dev, 1, &inFlightFences[currFrame]); // has to be unsignaled for vkQueueSubmit
-	vkQueueSubmit(gQueue, 1, &si, inFlightFences[currFrame]);
+	if (vkQueueSubmit(gQueue, 1, &si, VK_NULL_HANDLE) != VK_SUCCESS) {
+		throw std::runtime_error("cannot submit frame!");
+	}
+
+	endFrame();
 
 	VkPresentInfoKHR pInfo{};
 	pInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -268,15 +452,12 @@ void appvk::drawFrame() {
 	pInfo.pImageIndices = &nextFrame;
 
 	r = vkQueuePresentKHR(gQueue, &pInfo);
+
 	if (r == VK_ERROR_OUT_OF_DATE_KHR || resizeOccurred) {
-		recreateSwapChain();
-		resizeOccurred = false;
-		return;
+		resizeOccurred = !recreateSwapChain();
 	} else if (r != VK_SUCCESS && r != VK_SUBOPTIMAL_KHR) {
 		throw std::runtime_error("cannot submit to queue!");
 	}
-
-	currFrame = (currFrame + 1) % options::framesInFlight;
 }
 
 void appvk::run() {
@@ -299,30 +480,46 @@ void appvk::run() {
 appvk::~appvk() {
 
     cleanupSwapChain();
+    flushRetired(); // run() left the device idle
+    vkDestroySwapchainKHR(dev, swap, nullptr);
+    cleanupRenderPass();
+
+    stopPacingWatcher();
+    destroySyncs();
+
+    vkDestroyDescriptorPool(dev, dPool, nullptr);
 
 	for (thing& t : things) {
+		vkDestroyPipelineLayout(dev, t.pipeLayout, nullptr);
 		vkDestroyDescriptorSetLayout(dev, t.layout, nullptr);
 
-		for (texture tx : t.maps) {
+		for (texture& tx : t.maps) {
 			vkDestroySampler(dev, tx.samp, nullptr);
 			vkDestroyImageView(dev, tx.view, nullptr);
 			vkDestroyImage(dev, tx.im, nullptr);
-			vkFreeMemory(dev, tx.mem, nullptr);
-			tx.mem = VK_NULL_HANDLE; // prevent other frees from failing if all textures allocated together
+			allocator.free(tx.mem);
 		}
+	}
 
-		vkDestroyBuffer(dev, t.index.buf, nullptr);
-		vkFreeMemory(dev, t.index.mem, nullptr);
-		t.index.mem = VK_NULL_HANDLE;
+    freeTransientSlots();
 
-		vkDestroyBuffer(dev, t.vert.buf, nullptr);
-		vkFreeMemory(dev, t.vert.mem, nullptr);
-		t.vert.mem = VK_NULL_HANDLE;
+    vkDestroyBuffer(dev, uniforms.buf.buf, nullptr);
+    allocator.free(uniforms.buf.mem);
+    destroyPyramidPipeline();
+    destroyCullPass();
+    destroyInstanceBuffer();
+
+	for (uploadBatch& b : uploads) {
+		waitUpload(b);
 	}
 
-    vkDestroyCommandPool(dev, cp, nullptr);
+	vkDestroySemaphore(dev, uploadTimeline, nullptr);
+	destroyStagingArena();
+	destroyMeshPool();
 
-	ImGui_ImplVulkan_Shutdown();
+    destroyRecorders();
+    vkDestroyCommandPool(dev, cp, nullptr);
+    vkDestroyCommandPool(dev, tcp, nullptr);
 
 	vkDestroyCommandPool(dev, ccp, nullptr);
 
@@ -330,14 +527,20 @@ appvk::~appvk() {
 	vkDestroyPipelineLayout(dev, cPipeLayout, nullptr);
 
 	vkDestroyBuffer(dev, ibuf.buf, nullptr);
-	vkFreeMemory(dev, ibuf.mem, nullptr);
+	allocator.free(ibuf.mem);
 
 	vkDestroyBuffer(dev, obuf.buf, nullptr);
-	vkFreeMemory(dev, obuf.mem, nullptr);
+	allocator.free(obuf.mem);
 
 	vkDestroyDescriptorSetLayout(dev, cLayout, nullptr);
 	vkDestroyDescriptorPool(dev, cPool, nullptr);
 
+    savePipelineCache();
+    vkDestroyPipelineCache(dev, pipeCache, nullptr);
+    destroyProfiler();
+
+    allocator.destroy();
+
     vkDestroyDevice(dev, nullptr);
     vkDestroySurfaceKHR(instance, surf, nullptr);
 
@@ -346,10 +549,7 @@ appvk::~appvk() {
 }
 
 int main(int argc, char **argv) {
-	(void)argc;
-	(void)argv;
-
-	appvk app;
+	appvk app(argc, argv);
 	try {
 		app.run();
 	} catch (const std::exception& e) {
@@ -6,22 +6,33 @@
 #include <optional> // C++17, for device queue querying
 #include <utility> // for std::pair
 #include <tuple>
+#include <deque>
+#include <functional>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 
 #include "glm_mat_wrapper.hpp"
 
 #include "base.hpp"
+#include "vmem.hpp"
+#include "workers.hpp"
 
-#include "vformat.hpp"
+#include "pvert.hpp"
 #include "camera.hpp"
 #include "terrain.hpp"
 
 using std::cout;
 using std::cerr;
 
+const char* presentModeName(VkPresentModeKHR mode);
+std::optional<VkPresentModeKHR> parsePresentMode(std::string_view name); // fifo, fifo_relaxed, mailbox or immediate
+
 class appvk : basevk {
 public:
 
-	appvk();
+	appvk(int argc, char** argv); // see parseArgs
 	~appvk();
 
 	void run();
@@ -39,6 +50,7 @@ private:
     enum manufacturer { nvidia, intel, any };
 
     bool checkDeviceExtensions(VkPhysicalDevice pdev);
+    bool hasDeviceExtension(VkPhysicalDevice pdev, std::string_view name);
     VkSampleCountFlagBits getSamples(unsigned int try_samples);
     void checkChooseDevice(VkPhysicalDevice pd, manufacturer m);
     void pickPhysicalDevice(manufacturer m);
@@ -61,30 +73,38 @@ private:
     queueIndices findQueueFamily(VkPhysicalDevice pd);
     swapChainSupportDetails querySwapChainSupport(VkPhysicalDevice pdev);
     VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& formatList);
-    VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& modeList);
+    VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& modeList); // wantedPresentMode or FIFO
     VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& cap);
 	
 	VkDevice dev = VK_NULL_HANDLE;
 	VkQueue gQueue = VK_NULL_HANDLE;
 	VkQueue cQueue = VK_NULL_HANDLE;
+	VkQueue tQueue = VK_NULL_HANDLE; // same as gQueue if there is no transfer-only family
 	uint32_t gQueueFamily;
 	uint32_t cQueueFamily;
+	uint32_t tQueueFamily;
+	bool memoryBudget = false; // VK_EXT_memory_budget is enabled
+	bool drawIndirectCount = false; // vkCmdDrawIndexedIndirectCount is usable
+	bool multiDrawIndirect = false; // more than one draw per vkCmdDrawIndexedIndirect
+	bool hostQueryReset = false; // vkResetQueryPool is usable
     void createLogicalDevice();
 
+	vmem::allocator allocator; // all buffer and image memory is sub-allocated from here
+
 	struct buffer {
 		VkBuffer buf = VK_NULL_HANDLE;
-		VkDeviceMemory mem = VK_NULL_HANDLE;
+		vmem::allocation mem;
 	};
 
 	struct bufslab {
 		std::vector<VkBuffer> bufs;
-		VkDeviceMemory mem = VK_NULL_HANDLE;
+		vmem::allocation mem;
 		VkDeviceSize elemSize = 0; // _actual_ size of a buffer in mem (due to GPU memory alignment)
 	};
 
 	struct image {
 		VkImage im = VK_NULL_HANDLE;
-		VkDeviceMemory mem = VK_NULL_HANDLE;
+		vmem::allocation mem;
 		VkImageView view = VK_NULL_HANDLE;
 		unsigned int mipLevels = 0;
 	};
@@ -96,9 +116,11 @@ private:
 	struct thing {
 		std::string name;
 
-		buffer vert;
-		buffer index;
-		unsigned int indices = 0;
+		uint32_t meshId = 0; // in meshes
+
+		// every copy of this thing is drawn with one indirect call, each instance's lod is picked by cull.comp
+		uint32_t firstInstance = 0;
+		uint32_t instanceCount = 0;
 
 		std::array<texture, 3> maps;
 		texture& diff = maps[0];
@@ -107,7 +129,7 @@ private:
 
 		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
 		std::vector<VkDescriptorSet> dsets;
-		bufslab ubos;
+		uint32_t uboOffset = 0; // dynamic offset of this frame's ubo in the uniform ring
 
 		VkPipelineLayout pipeLayout = VK_NULL_HANDLE;
 		VkPipeline pipe = VK_NULL_HANDLE;
@@ -135,6 +157,9 @@ private:
 	std::vector<VkImage> swapImages;
 	VkFormat swapFormat;
 	VkExtent2D swapExtent;
+	VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR; // what the swapchain was made with
+	VkPresentModeKHR requestedPresentMode = VK_PRESENT_MODE_FIFO_KHR; // what wantedPresentMode was at the time
+	std::vector<VkPresentModeKHR> presentModes; // what the surface supports, as of the last swapchain
     std::vector<VkImageView> swapImageViews;
     void createSurface();
 	void createSwapChain();
@@ -144,16 +169,171 @@ private:
     VkImageView createImageView(VkImage im, VkFormat format, unsigned int mipLevels, VkImageAspectFlags aspectMask);
 	
 	VkRenderPass renderPass = VK_NULL_HANDLE;
+	VkRenderPass earlyPass = VK_NULL_HANDLE; // clears and draws what was visible last frame, renderPass finishes the frame
 
     void createRenderPass();
 
 	struct ubo {
-		alignas(16) glm::mat4 model;
 		alignas(16) glm::mat4 view;
 		alignas(16) glm::mat4 proj;
+		alignas(16) glm::vec4 posScale; // undoes the snorm16 position quantisation
+		alignas(16) glm::vec4 posOffset;
+		alignas(16) glm::vec4 eye; // camera position
+	};
+
+	// per-frame uniform data comes out of one persistently mapped buffer with a region per frame in flight.
+	// a region is only reused once the frame that last wrote to it has finished.
+	struct uniformRing {
+		buffer buf;
+		VkDeviceSize regionSize = 0;
+		VkDeviceSize align = 0; // minUniformBufferOffsetAlignment
+		VkDeviceSize regionStart = 0; // start of the region owned by the frame being recorded
+		VkDeviceSize head = 0; // next free byte in that region
+	};
+
+	uniformRing uniforms;
+	void createUniformRing();
+	void beginUniformFrame(uint32_t frame);
+	void* allocUniform(VkDeviceSize size, uint32_t& offset);
+
+	// matches struct instance in shader.vert, std430
+	struct instanceData {
+		alignas(16) glm::mat4 model;
+		uint32_t batch = 0; // index of the thing this is drawn with
+		uint32_t pad[3] = {}; // the shader's array stride is 80
+	};
+
+	// instances live in a persistently mapped storage buffer with a region per frame in flight, indexed with
+	// gl_InstanceIndex. data is the source of truth, and a frame's region only gets the range that changed since
+	// that region was last written.
+	struct instanceBuffer {
+		buffer buf;
+		VkDeviceSize regionSize = 0;
+		uint32_t capacity = 0;
+		std::vector<instanceData> data;
+		std::vector<std::pair<uint32_t, uint32_t>> dirty; // [begin, end) per frame in flight
+	};
+
+	instanceBuffer instances;
+	void createInstanceBuffer(uint32_t capacity);
+	void destroyInstanceBuffer();
+	void addInstances(thing& t, const std::vector<glm::mat4>& models);
+	void setInstance(uint32_t i, const glm::mat4& model);
+	void markInstances(uint32_t begin, uint32_t end);
+	void flushInstances(uint32_t frame);
+	void allocDescriptorSetInstances(thing& t);
+
+	// frustum culling, occlusion culling and lod selection run on the gpu. a compute pass writes an indirect draw per
+	// instance, compacted per thing with a draw count when drawIndirectCount is supported. it runs once before earlyPass
+	// and once more against the depth pyramid before renderPass.
+	struct cullPass {
+		buffer draws; // mesh bounds and lods per thing
+		buffer commands; // a VkDrawIndexedIndirectCommand slot per instance and phase
+		buffer counts; // triangles, visible and occluded instances, then a draw count per thing and phase
+		buffer stats; // counts copied back, a region per frame in flight
+		buffer visibility; // per instance, whether it was visible at the end of the last frame
+		VkDeviceSize countSize = 0;
+		uint32_t uboOffset = 0; // this frame's cullData in the uniform ring
+
+		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+		VkDescriptorPool pool = VK_NULL_HANDLE;
+		std::vector<VkDescriptorSet> sets; // per frame in flight, so a new pyramid never touches a set that's in use
+		std::vector<uint32_t> pyramidBound; // hiz.generation each set's pyramid binding was last written for
+		VkPipelineLayout pipeLayout = VK_NULL_HANDLE;
+		VkPipeline pipe = VK_NULL_HANDLE;
+
+		uint32_t triangles = 0; // as of the last finished frame
+		uint32_t visible = 0;
+		uint32_t occluded = 0;
+	};
+
+	cullPass cull;
+	glm::mat4 viewProj = glm::mat4(1.0f); // set in updateFrame
+	float pixelsPerUnit = 0.0f; // screen pixels covered by one unit at distance 1, set in updateFrame
+	void createCullPass();
+	void destroyCullPass();
+	void writeDrawInfo();
+	void recordCull(VkCommandBuffer cbuf, uint32_t phase);
+	void drawCulled(VkCommandBuffer cbuf, const thing& t, uint32_t batch, uint32_t phase);
+	void readCullStats(uint32_t frame);
+
+	// each texel holds the farthest depth under it, level 0 is the size of the screen. built every frame from the
+	// depth earlyPass leaves behind, for the late cull phase.
+	struct depthPyramid {
+		image im; // im.view covers every level, for sampling
+		std::vector<VkImageView> views; // a storage view per level
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t generation = 0; // bumped every time it's recreated
+		VkSampler samp = VK_NULL_HANDLE; // nearest, everything is read with texelFetch
+
+		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+		VkDescriptorPool pool = VK_NULL_HANDLE;
+		std::vector<VkDescriptorSet> sets; // per level
+		VkPipelineLayout pipeLayout = VK_NULL_HANDLE;
+		VkPipeline pipe = VK_NULL_HANDLE;
+	};
+
+	depthPyramid hiz;
+	void createPyramidPipeline();
+	void destroyPyramidPipeline();
+	void createDepthPyramid(); // sized to the swapchain
+	void destroyDepthPyramid(); // retired, frames in flight may still use it
+	void recordPyramid(VkCommandBuffer cbuf);
+
+	// gpu timestamps around named scopes, which nest in the order they're recorded unless they name a parent. every frame
+	// in flight writes its own query pool and reads back what its last frame wrote once beginFrame has waited for it, so
+	// results are a few frames old and reading them never stalls. command buffers outside of frames, like upload
+	// batches, get a timer of their own.
+	struct gpuScope {
+		const char* name; // has to outlive the profiler, normally a literal
+		const char* parent; // for scopes recorded outside the one they run in, like a secondary recorded ahead of time
+		uint32_t depth; // only for scopes without a parent
+		uint32_t query; // the scope's end is the next one
+	};
+
+	struct profilerFrame {
+		VkQueryPool pool = VK_NULL_HANDLE;
+		std::vector<gpuScope> scopes;
+		std::vector<uint32_t> open; // indices into scopes
+		bool recorded = false; // has scopes that haven't been read yet
+	};
+
+	// the last options::profilerHistory times of a scope, in ms
+	struct scopeHistory {
+		const char* name;
+		uint32_t depth;
+		std::vector<float> ms;
+		size_t next = 0;
 	};
 
-	void createUniformBuffers();    
+	struct gpuTimer {
+		VkQueryPool pool = VK_NULL_HANDLE; // null if the queue can't be timed
+		const char* name = nullptr;
+		uint32_t family = 0;
+	};
+
+	struct gpuProfiler {
+		std::vector<profilerFrame> frames; // per frame in flight, empty if the graphics queue can't write timestamps
+		std::vector<scopeHistory> scopes; // every scope seen so far, in the order they were first seen
+		std::vector<VkQueueFamilyProperties> families;
+		float period = 0.0f; // nanoseconds per tick
+	};
+
+	gpuProfiler prof;
+	gpuTimer cTimer; // around the compute test's dispatch, read once runCompute has waited for it
+	void createProfiler();
+	void destroyProfiler();
+	void beginProfilerFrame(VkCommandBuffer cbuf); // resets currFrame's pool, before any scope in the frame
+	void readProfilerFrame(uint32_t frame); // the last frame to use frame's slot is done
+	void beginScope(VkCommandBuffer cbuf, const char* name, const char* parent = nullptr);
+	void endScope(VkCommandBuffer cbuf);
+	gpuTimer beginTimer(VkCommandBuffer cbuf, uint32_t family, const char* name);
+	void endTimer(VkCommandBuffer cbuf, const gpuTimer& timer);
+	void readTimer(gpuTimer& timer); // once the command buffer is done, destroys the pool
+	void addScopeTime(const char* name, uint32_t depth, float ms, const char* parent = nullptr);
+	float tickMs(uint64_t begin, uint64_t end, uint32_t family);
+
     void createDescriptorSetLayout();
 
     VkDescriptorPool dPool = VK_NULL_HANDLE;
@@ -164,6 +344,27 @@ private:
 	void allocDescriptorSetUniform(thing& t);
 	void allocDescriptorSetTexture(thing& t, texture tex, size_t index);
 
+	// every pipeline, imgui's too, shares one cache that is kept on disk between runs
+	VkPipelineCache pipeCache = VK_NULL_HANDLE;
+	size_t pipeCacheLoaded = 0; // bytes of usable cache data found at startup, 0 if it started cold
+	std::mutex pipelineStatsLock; // builds run on several threads at once
+	float pipelineMs = 0.0f; // time spent in buildPipelines so far, summed over threads
+	uint32_t pipelineCount = 0;
+	float pipelineWaitMs = 0.0f; // time the main thread spent blocked in waitPipelines
+	void createPipelineCache();
+	void savePipelineCache();
+	VkResult buildPipelines(uint32_t count, const VkGraphicsPipelineCreateInfo* infos, VkPipeline* pipes);
+	VkResult buildPipelines(uint32_t count, const VkComputePipelineCreateInfo* infos, VkPipeline* pipes);
+
+	// pipelines compile on buildPool while the caller gets on with loading and setup. a job writes its own
+	// pipeline handles, which are only safe to use after waitPipelines(). declared after everything a job touches,
+	// so a pending build is finished before any of that is destroyed.
+	std::optional<workers::pool> buildPool;
+	std::vector<std::shared_future<void>> pendingPipelines;
+	std::shared_future<void> buildAsync(std::function<void()> job);
+	std::shared_future<void> buildComputeAsync(std::string spvPath, VkPipelineLayout layout, VkPipeline* pipe, std::string name);
+	void waitPipelines();
+
 	std::vector<char> readFile(std::string_view path);
     VkShaderModule createShaderModule(const std::vector<char>& spv);
 	
@@ -173,65 +374,269 @@ private:
     void printShaderStats(const thing& t);
 
 	std::vector<VkFramebuffer> swapFramebuffers; // ties render attachments to image views in the swapchain
+	VkFramebuffer earlyFramebuffer = VK_NULL_HANDLE; // just ms and depth, nothing is resolved until renderPass
     void createFramebuffers();
 
 	VkCommandPool cp = VK_NULL_HANDLE;
+	VkCommandPool tcp = VK_NULL_HANDLE; // for the transfer queue
 	void createCommandPool();
 
-	uint32_t findMemoryType(uint32_t legalMemoryTypes, VkMemoryPropertyFlags properties);
-    buffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags props);
-	bufslab createBuffers(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags props, unsigned int count);
+	// props are required, hint picks the best memory type among those that have them
+    buffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags props, vmem::usage hint = vmem::usage::gpuOnly,
+		vmem::category cat = vmem::category::other);
+	bufslab createBuffers(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags props, unsigned int count,
+		vmem::usage hint = vmem::usage::gpuOnly, vmem::category cat = vmem::category::other);
+	buffer createSharedBuffer(VkDeviceSize size, VkBufferUsageFlags usage, vmem::category cat);
 
     VkCommandBuffer beginSingleCommand();
     void endSingleCommand(VkCommandBuffer buf);
 
 	image createImage(unsigned int width, unsigned int height, VkFormat format, unsigned int mipLevels,
-		VkSampleCountFlagBits samples, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags props);
-    void transitionImageLayout(image image, VkImageLayout oldl, VkImageLayout newl);
+		VkSampleCountFlagBits samples, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags props,
+		vmem::category cat = vmem::category::other);
+    void transitionImageLayout(VkCommandBuffer buf, image image, VkImageLayout oldl, VkImageLayout newl);
     
-    void copyBufferToImage(VkBuffer buf, VkImage img, uint32_t width, uint32_t height);
-    void copyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size);
+    void copyBufferToImage(VkCommandBuffer cbuf, VkBuffer buf, VkImage img, uint32_t width, uint32_t height, VkDeviceSize offset = 0);
+    void copyBuffer(VkCommandBuffer buf, VkBuffer src, VkBuffer dst, VkDeviceSize size, VkDeviceSize srcOffset = 0, VkDeviceSize dstOffset = 0);
+
+	// persistently mapped host memory that all uploads are staged through. it is split into chunks that are
+	// handed to one upload batch at a time and filled linearly, then reused once the batch finishes.
+	struct stagingChunk {
+		buffer buf;
+		VkDeviceSize size = 0;
+		VkDeviceSize head = 0; // next free byte
+	};
 
-    buffer createVertexBuffer(std::vector<vformat::vertex>& v);
-	buffer createVertexBuffer(const std::vector<uint8_t>& verts);
+	struct stagingArena {
+		std::vector<stagingChunk> chunks;
+		std::vector<uint32_t> freeChunks; // not owned by any batch
+		VkDeviceSize align = 16;
+		VkDeviceSize reserved = 0;
+		VkDeviceSize inUse = 0; // bytes handed out to batches that haven't finished
+		VkDeviceSize highWater = 0; // most bytes ever in use at once
+	};
 
-    buffer createIndexBuffer(const std::vector<uint32_t>& indices);
+	struct stagingSlice {
+		VkBuffer buf = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+	};
+
+	stagingArena staging;
+	void createStagingArena();
+	void destroyStagingArena();
+	uint32_t growStagingArena(VkDeviceSize size);
+	bool trimStagingArena();
+
+	// records any number of copies, transitions and mip chains into one command buffer that is submitted with
+	// a single fence. staging buffers stay alive until that fence signals.
+	// async batches copy on the transfer queue and hand everything over to the graphics queue, which runs
+	// whatever needs it (mip blits) in gfx. the two submits are ordered with the upload timeline.
+	struct uploadBatch {
+		VkCommandBuffer cbuf = VK_NULL_HANDLE; // copies, on the transfer queue if async
+		VkCommandBuffer gfx = VK_NULL_HANDLE; // graphics queue work, same as cbuf if not async
+		VkFence fence = VK_NULL_HANDLE;
+		std::vector<uint32_t> chunks; // staging arena chunks owned by this batch, the last one is being filled
+		bool submitted = false;
+		bool async = false;
+		uint64_t value = 0; // upload timeline value signalled once the batch is usable by the graphics queue
+		gpuTimer timer; // around the copies
+	};
+
+	VkSemaphore uploadTimeline = VK_NULL_HANDLE;
+	uint64_t uploadValue = 0; // last value handed out
+	std::vector<uploadBatch> uploads; // submitted batches that are polled every frame until they finish
+	void createUploadTimeline();
+
+	uploadBatch beginUpload(bool async = false);
+	stagingSlice stageUpload(uploadBatch& b, const void* data, VkDeviceSize size);
+	void handOverBuffer(uploadBatch& b, VkBuffer buf, VkAccessFlags dstAccess, VkPipelineStageFlags dstStage);
+	void handOverImage(uploadBatch& b, const image& im);
+	void submitUpload(uploadBatch& b);
+	bool uploadDone(uploadBatch& b); // non-blocking, releases the batch once the gpu is done with it
+	void waitUpload(uploadBatch& b); // blocks until the batch is done, submitting it first if needed
+	void releaseUpload(uploadBatch& b);
+
+	// all mesh data lives in one vertex buffer and one index buffer carved up with vmem::tlsf, so geometry is bound
+	// once per frame and meshes are addressed with vertexOffset / firstIndex
+	struct mesh {
+		uint32_t vertHandle = vmem::tlsf::invalid;
+		uint32_t indexHandle = vmem::tlsf::invalid;
+		uint32_t vertexCount = 0;
+		uint32_t indexCount = 0;
+		int32_t vertexOffset = 0; // in vertices
+		uint32_t firstIndex = 0; // in indices
+		VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+		pvert::bounds box; // positions are quantised against this
+		std::array<pvert::lod, pvert::maxLods> lods = {};
+		uint32_t lodCount = 0;
+		bool live = false;
+	};
 
-	texture createTextureImage(int width, int height, const uint8_t* data, bool makeMips = true);
+	struct meshPool {
+		buffer vert;
+		buffer index;
+		std::optional<vmem::tlsf> vertRange;
+		std::optional<vmem::tlsf> indexRange;
+		std::vector<mesh> meshes; // indexed by mesh id, ids of freed meshes get reused
+	};
+
+	meshPool meshes;
+	void createMeshPool(VkDeviceSize vertBytes, VkDeviceSize indexBytes);
+	void destroyMeshPool();
+	uint32_t uploadMesh(uploadBatch& b, const pvert::view& v);
+	void freeMesh(uint32_t id);
+	void compactMeshPool();
+
+	texture createTextureImage(uploadBatch& b, int width, int height, const uint8_t* data, bool makeMips = true);
 
     VkSampler createSampler(unsigned int mipLevels);
-	void generateMipmaps(VkImage image, VkFormat format, unsigned int width, unsigned int height, unsigned int levels);
+	void generateMipmaps(VkCommandBuffer b, VkImage image, VkFormat format, unsigned int width, unsigned int height, unsigned int levels);
+
+	// transient attachments get lazily allocated memory where the device has it. each one is assigned to a memory slot,
+	// and attachments whose passes don't overlap share a slot. slots only ever grow, so a resize usually just binds the
+	// new images to the memory that's already there.
+	struct transientAttachment {
+		image* target;
+		VkFormat format;
+		VkImageUsageFlags usage; // TRANSIENT_ATTACHMENT is added unless kept is set
+		VkImageAspectFlags aspect;
+		uint32_t firstPass; // range of passes that use the attachment, inclusive
+		uint32_t lastPass;
+		bool kept = false; // stored between passes or read outside of one, so it needs real memory
+	};
+
+	std::vector<vmem::allocation> transientSlots;
+	std::vector<image*> transientImages; // images currently bound to the slots
+	void createTransientAttachments(const std::vector<transientAttachment>& attachments);
+	void destroyTransientAttachments();
+	void freeTransientSlots();
 
 	image depth;
 	VkFormat depthFormat;
-    void createDepthImage();
 
 	image ms;
-    void createMultisampleImage();
+    void createAttachments();
 	
-	std::vector<VkCommandBuffer> commandBuffers;
+	std::vector<VkCommandBuffer> commandBuffers; // per frame in flight, so they don't depend on the swapchain
 	
 	void allocRenderCmdBuffers();
 
+	// draws are recorded into secondary command buffers by worker threads, a slice of things each. command pools can't be
+	// used from two threads at once, so every slice has its own pool per frame in flight.
+	// everything that changes per frame is read from buffers, so the draws are kept and only re-recorded when the scene
+	// changes. the ui is recorded every frame.
+	struct recorder {
+		VkCommandPool pool = VK_NULL_HANDLE;
+		std::array<VkCommandBuffer, 2> bufs = {}; // early and late pass
+		size_t begin = 0; // range of things
+		size_t end = 0;
+		float ms = 0.0f; // cpu time spent recording, as of the last time it ran
+	};
+
+	// what a frame in flight's draws were recorded with
+	struct sceneRecording {
+		uint64_t version = 0; // sceneVersion at the time, 0 if never recorded
+		std::vector<uint32_t> uboOffsets; // per thing, dynamic offsets are baked in too
+	};
+
+	std::optional<workers::pool> recordPool;
+	std::vector<recorder> recorders; // options::recordThreads per frame in flight
+	std::vector<sceneRecording> recordings; // per frame in flight
+	std::vector<VkCommandBuffer> uiBuffers; // per frame in flight, recorded on the main thread
+	uint64_t sceneVersion = 1; // bumped when anything the draws bind, or how many there are, changes
+	uint32_t sceneRecords = 0; // times the draws have been recorded
+	float recordMs = 0.0f; // main thread time spent recording the last frame, including waiting for the workers
+	void createRecorders();
+	void destroyRecorders();
+	void recordThings(VkCommandBuffer cbuf, size_t begin, size_t end, uint32_t phase);
+	bool recordingScene = false; // the workers are recording, executeSecondaries waits for them
+	void recordSecondaries();
+	void recordUi(uint32_t image);
+	void executeSecondaries(VkCommandBuffer cbuf, uint32_t phase);
+
 	// swapchain image acquisition requires a binary semaphore since it might be hard for implementations to do timeline semaphores
 	std::vector<VkSemaphore> imageAvailSems; // use seperate semaphores per frame so we can send >1 frame at once
 	std::vector<VkSemaphore> renderDoneSems;
-	std::vector<VkFence> inFlightFences; // use fences so we actually wait until a frame completes before moving on to the next one
-	std::vector<VkFence> imagesInFlight; // track frames in flight because acquireNextImageKHR may not return swapchain indices in order
+
+	// frame pacing. every frame's submit signals frameTimeline with the frame's number, counting from 1, so frame n is
+	// done once the counter reaches n. anything can wait on that instead of keeping fences of its own.
+	// currFrame picks the per frame resources and is framesSubmitted % framesInFlight.
+	VkSemaphore frameTimeline = VK_NULL_HANDLE;
+	uint32_t framesInFlight = 0; // how far the cpu can run ahead, at most options::maxFramesInFlight
+	uint64_t framesSubmitted = 0; // also the number of the last submitted frame
     void createSyncs();
+	void createFrameSemaphores();
+	void destroySyncs();
+	uint64_t framesCompleted();
+	void waitFrame(uint64_t frame);
+	void beginFrame(); // blocks until currFrame's resources are free
+	void endFrame(); // after the frame's submit
+
+	// both can be changed from the command line and the overlay. they're applied between frames, a new present mode
+	// makes a new swapchain and a new frame count waits for whatever is in flight.
+	VkPresentModeKHR wantedPresentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+	uint32_t wantedFramesInFlight = 0;
+	void parseArgs(int argc, char** argv);
+	void applyFrameSettings();
+
+	// latency and throughput per combination of present mode and frames in flight. a thread waits on frameTimeline for
+	// each frame in turn and notes when it finished, latency is from beginFrame returning until then.
+	struct pacingStats {
+		VkPresentModeKHR mode;
+		uint32_t framesInFlight;
+		uint64_t frames = 0;
+		double latencySum = 0.0; // ms
+		float latencyMax = 0.0f;
+		double intervalSum = 0.0; // ms between consecutive frames finishing
+		uint64_t intervals = 0;
+	};
+
+	struct frameRecord {
+		std::chrono::steady_clock::time_point start;
+		size_t config = 0; // index into pacing
+	};
+
+	// everything here is guarded by pacingLock
+	std::mutex pacingLock;
+	std::condition_variable pacingWake;
+	std::vector<pacingStats> pacing; // every combination used so far
+	size_t pacingConfig = 0; // the current one
+	std::array<frameRecord, 256> frameRecords = {}; // by frame number, the watcher is never that far behind
+	uint64_t pacingSubmitted = 0; // framesSubmitted as far as the watcher knows
+	bool pacingQuit = false;
+
+	std::thread pacingThread;
+	void usePacingConfig(); // finds or adds the current combination
+	void startPacingWatcher();
+	void stopPacingWatcher(); // before frameTimeline is destroyed
+	void watchFrames();
+
+	// objects that frames still in flight may be using, like everything sized to the swapchain after a resize.
+	// each is destroyed once every frame submitted before it was retired has finished.
+	struct retiredObject {
+		uint64_t frame; // framesSubmitted at the time
+		std::function<void()> destroy;
+	};
+
+	std::deque<retiredObject> retired;
+	void retire(std::function<void()> destroy);
+	void collectRetired(); // called by beginFrame
+	void flushRetired(); // the device has to be idle
 
 	void initVulkanUI();
 	
-    void recreateSwapChain();
+	// false if the window is minimised and there is nothing to make a swapchain for yet
+    bool recreateSwapChain();
 
 	// this scene is set up so that the camera is in -Z looking towards +Z.
     cam::camera c;
 	
-    void updateFrame(uint32_t imageIndex);
+    void updateFrame();
 
 	uint32_t currFrame = 0;
 
 	void drawFrame();
 
     void cleanupSwapChain();
+    void cleanupRenderPass();
 };
@@ -0,0 +1,196 @@
+#include "mcache.hpp"
+
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace mcache {
+
+    static constexpr const char* cacheDir = "cache";
+
+    // FNV-1a, fine for telling files apart, not for anything adversarial
+    static uint64_t hash(const void* data, size_t size, uint64_t h = 0xcbf29ce484222325ull) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; i++) {
+            h = (h ^ p[i]) * 0x100000001b3ull;
+        }
+
+        return h;
+    }
+
+    static bool hashFile(const std::string& path, uint64_t& h) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            return false;
+        }
+
+        std::vector<char> buf(1 << 16);
+        h = 0xcbf29ce484222325ull;
+        while (in) {
+            in.read(buf.data(), buf.size());
+            h = hash(buf.data(), in.gcount(), h);
+        }
+
+        return true;
+    }
+
+    static bool sourceStat(const std::string& path, int64_t& mtime, uint64_t& size) {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) {
+            return false;
+        }
+
+        mtime = int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+        size = st.st_size;
+        return true;
+    }
+
+    std::string cachePath(std::string_view src) {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.vmesh", (unsigned long long)hash(src.data(), src.size()));
+        return std::string(cacheDir) + "/" + name;
+    }
+
+    bool file::open(std::string_view src) {
+        close();
+
+        std::string srcPath(src);
+        int64_t mtime;
+        uint64_t size;
+        if (!sourceStat(srcPath, mtime, size)) {
+            return false;
+        }
+
+        std::string path = cachePath(src);
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(header)) {
+            ::close(fd);
+            return false;
+        }
+
+        length = st.st_size;
+        base = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd); // the mapping keeps the file alive
+
+        if (base == MAP_FAILED) {
+            base = nullptr;
+            return false;
+        }
+
+        const header& h = info();
+        bool ok = memcmp(h.magic, header{}.magic, sizeof(h.magic)) == 0
+            && h.version == version
+            && h.vertexSize == sizeof(pvert::vertex)
+            && (h.indexSize == 2 || h.indexSize == 4)
+            && h.lodCount >= 1 && h.lodCount <= pvert::maxLods
+            && h.pathHash == hash(src.data(), src.size())
+            && h.vertexOffset % alignof(pvert::vertex) == 0
+            && h.indexOffset % h.indexSize == 0
+            && h.vertexOffset + uint64_t(h.vertexCount) * sizeof(pvert::vertex) <= length
+            && h.indexOffset + uint64_t(h.indexCount) * h.indexSize <= length
+            && h.lods[0].firstIndex == 0;
+
+        // the lod ranges go straight into indirect draws, so one past indexCount would read another mesh's indices
+        for (uint32_t i = 0; ok && i < h.lodCount; i++) {
+            ok = uint64_t(h.lods[i].firstIndex) + h.lods[i].indexCount <= h.indexCount;
+        }
+
+        // touching the source without changing it (like a fresh checkout) shouldn't throw the cache away
+        if (ok && (h.srcMtime != mtime || h.srcSize != size)) {
+            uint64_t srcHash;
+            ok = h.srcSize == size && hashFile(srcPath, srcHash) && srcHash == h.srcHash;
+        }
+
+        if (!ok) {
+            close();
+            return false;
+        }
+
+        // the whole file is about to be copied into staging
+        madvise(base, length, MADV_WILLNEED);
+
+        return true;
+    }
+
+    void file::close() {
+        if (base != nullptr) {
+            munmap(base, length);
+        }
+
+        base = nullptr;
+        length = 0;
+    }
+
+    pvert::view file::get() const {
+        const header& h = info();
+        const char* p = static_cast<const char*>(base);
+
+        pvert::view v;
+        v.verts = reinterpret_cast<const pvert::vertex*>(p + h.vertexOffset);
+        v.vertexCount = h.vertexCount;
+        v.indices = p + h.indexOffset;
+        v.indexCount = h.indexCount;
+        v.indexSize = h.indexSize;
+        v.box = h.box;
+        v.lods = h.lods;
+        v.lodCount = h.lodCount;
+        return v;
+    }
+
+    void write(std::string_view src, const pvert::packed& mesh) {
+        std::string srcPath(src);
+
+        header h;
+        h.vertexCount = mesh.verts.size();
+        h.indexCount = mesh.indexCount;
+        h.indexSize = mesh.indexSize;
+        h.box = mesh.box;
+        h.lods = mesh.lods;
+        h.lodCount = mesh.lodCount;
+        h.pathHash = hash(src.data(), src.size());
+        if (!sourceStat(srcPath, h.srcMtime, h.srcSize) || !hashFile(srcPath, h.srcHash)) {
+            return;
+        }
+
+        auto alignUp = [](uint64_t x, uint64_t a) { return (x + a - 1) / a * a; };
+        h.vertexOffset = alignUp(sizeof(header), 16);
+        h.indexOffset = alignUp(h.vertexOffset + mesh.verts.size() * sizeof(pvert::vertex), 16);
+
+        mkdir(cacheDir, 0755);
+
+        // write to a temporary and rename, so a crash or a second instance never sees half a file
+        std::string path = cachePath(src);
+        std::string tmp = path + ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+            if (!out) {
+                return;
+            }
+
+            std::vector<char> pad(16, 0);
+            out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+            out.write(pad.data(), h.vertexOffset - sizeof(header));
+            out.write(reinterpret_cast<const char*>(mesh.verts.data()), mesh.verts.size() * sizeof(pvert::vertex));
+            out.write(pad.data(), h.indexOffset - h.vertexOffset - mesh.verts.size() * sizeof(pvert::vertex));
+            out.write(reinterpret_cast<const char*>(mesh.indices.data()), mesh.indices.size());
+
+            if (!out) {
+                out.close();
+                std::remove(tmp.c_str());
+                return;
+            }
+        }
+
+        std::rename(tmp.c_str(), path.c_str());
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+#include "pvert.hpp"
+
+// Binary mesh cache.
+// The first time a model is loaded its packed vertices and indices are written out exactly as they're uploaded,
+// and later runs mmap that file and copy straight out of it instead of going through assimp.
+namespace mcache {
+
+    constexpr uint32_t version = 4; // 2: meshes are stored after mopt::optimize, 3: pvert format, 4: lods
+
+    struct header {
+        char magic[4] = {'V', 'M', 'S', 'H'};
+        uint32_t version = mcache::version;
+        uint32_t vertexSize = sizeof(pvert::vertex); // layout changes invalidate the cache too
+        uint32_t vertexCount = 0;
+        uint32_t indexCount = 0;
+        uint32_t indexSize = 0;
+
+        // what the cache was built from. mtime and size are checked first, the hash only if they differ
+        uint64_t pathHash = 0;
+        int64_t srcMtime = 0;
+        uint64_t srcSize = 0;
+        uint64_t srcHash = 0;
+
+        pvert::bounds box;
+        std::array<pvert::lod, pvert::maxLods> lods = {};
+        uint32_t lodCount = 0;
+
+        uint64_t vertexOffset = 0; // from the start of the file
+        uint64_t indexOffset = 0;
+    };
+
+    // a read-only mapping of a cache file, data points into the mapping
+    class file {
+    public:
+        file() = default;
+        file(const file&) = delete;
+        file& operator=(const file&) = delete;
+        ~file() { close(); }
+
+        // returns false if there's no cache for src or it's out of date
+        bool open(std::string_view src);
+        void close();
+
+        bool valid() const { return base != nullptr; }
+
+        pvert::view get() const;
+        const header& info() const { return *static_cast<const header*>(base); }
+
+    private:
+        void* base = nullptr;
+        size_t length = 0;
+    };
+
+    // writes the cache for src, failing to write is not an error since the cache is only an optimisation
+    void write(std::string_view src, const pvert::packed& mesh);
+
+    // where the cache for src lives
+    std::string cachePath(std::string_view src);
+}
@@ -1,38 +1,53 @@
 #include "main.hpp"
 
-void appvk::copyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size) {
-    VkCommandBuffer buf = beginSingleCommand();
-
+void appvk::copyBuffer(VkCommandBuffer buf, VkBuffer src, VkBuffer dst, VkDeviceSize size, VkDeviceSize srcOffset, VkDeviceSize dstOffset) {
     VkBufferCopy copy{};
+    copy.srcOffset = srcOffset;
+    copy.dstOffset = dstOffset;
     copy.size = size;
 
     vkCmdCopyBuffer(buf, src, dst, 1, &copy);
-
-    endSingleCommand(buf);
 }
 
-// find a memory type that our image or buffer can use and that has the properties we want
-uint32_t appvk::findMemoryType(uint32_t legalMemoryTypes, VkMemoryPropertyFlags properties) {
-    VkPhysicalDeviceMemoryProperties memProp{};
-    vkGetPhysicalDeviceMemoryProperties(pdev, &memProp);
+appvk::buffer appvk::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags props, vmem::usage hint, vmem::category cat) {
+    VkBufferCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    createInfo.size = size;
+    createInfo.usage = usage;
+    createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-    // turn a one-hot legalMemoryTypes into an int representing the index we want in memoryTypes
-    for (size_t i = 0; i < memProp.memoryTypeCount; i++) {
-        // if the type matches one of the allowed types given to us and it has the right flags, return it
-        if ((legalMemoryTypes & (1 << i)) && (memProp.memoryTypes[i].propertyFlags & properties)) {
-            return i;
-        }
+    buffer buf;
+    if (vkCreateBuffer(dev, &createInfo, nullptr, &(buf.buf)) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create buffer!");
     }
 
-    throw std::runtime_error("cannot find proper memory type!");
+    VkMemoryRequirements mreq{};
+    vkGetBufferMemoryRequirements(dev, buf.buf, &mreq);
+
+    buf.mem = allocator.alloc(mreq, {props, 0, hint, cat}, true);
+
+    vkBindBufferMemory(dev, buf.buf, buf.mem.mem, buf.mem.offset);
+
+    return buf;
 }
 
-appvk::buffer appvk::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags props) {
+// device local buffer that the graphics and transfer queues can both use without ownership transfers, for buffers that
+// get streamed into while they're being drawn from
+appvk::buffer appvk::createSharedBuffer(VkDeviceSize size, VkBufferUsageFlags usage, vmem::category cat) {
+    std::array<uint32_t, 2> families = {gQueueFamily, tQueueFamily};
+
     VkBufferCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     createInfo.size = size;
     createInfo.usage = usage;
-    createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (gQueueFamily != tQueueFamily) {
+        createInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        createInfo.queueFamilyIndexCount = families.size();
+        createInfo.pQueueFamilyIndices = families.data();
+    } else {
+        createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    }
 
     buffer buf;
     if (vkCreateBuffer(dev, &createInfo, nullptr, &(buf.buf)) != VK_SUCCESS) {
@@ -42,22 +57,16 @@ appvk::buffer appvk::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, V
     VkMemoryRequirements mreq{};
     vkGetBufferMemoryRequirements(dev, buf.buf, &mreq);
 
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = mreq.size;
-    allocInfo.memoryTypeIndex = findMemoryType(mreq.memoryTypeBits, props);
-
-    if (vkAllocateMemory(dev, &allocInfo, nullptr, &(buf.mem)) != VK_SUCCESS) {
-        throw std::runtime_error("cannot allocate buffer memory!");
-    }
+    buf.mem = allocator.alloc(mreq, {VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, vmem::usage::gpuOnly, cat}, true);
 
-    vkBindBufferMemory(dev, buf.buf, buf.mem, 0);
+    vkBindBufferMemory(dev, buf.buf, buf.mem.mem, buf.mem.offset);
 
     return buf;
 }
 
-appvk::bufslab appvk::createBuffers(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags props, unsigned int count) {
-    bufslab s = { std::vector<VkBuffer>(count) };
+appvk::bufslab appvk::createBuffers(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags props, unsigned int count, vmem::usage hint, vmem::category cat) {
+    bufslab s;
+    s.bufs.resize(count);
 
     VkBufferCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -74,20 +83,16 @@ appvk::bufslab appvk::createBuffers(VkDeviceSize size, VkBufferUsageFlags usage,
     VkMemoryRequirements mreq{};
     vkGetBufferMemoryRequirements(dev, s.bufs[0], &mreq); // all buffers should have the same memory requirements
 
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = mreq.size * count;
-    allocInfo.memoryTypeIndex = findMemoryType(mreq.memoryTypeBits, props);
+    // every buffer after the first has to start on an aligned offset too
+    s.elemSize = (mreq.size + mreq.alignment - 1) / mreq.alignment * mreq.alignment;
 
-    if (vkAllocateMemory(dev, &allocInfo, nullptr, &s.mem) != VK_SUCCESS) {
-        throw std::runtime_error("cannot allocate buffer memory!");
-    }
+    VkMemoryRequirements slabReq = mreq;
+    slabReq.size = s.elemSize * count;
+    s.mem = allocator.alloc(slabReq, {props, 0, hint, cat}, true);
 
     for (size_t i = 0; i < count; i++) {
-        vkBindBufferMemory(dev, s.bufs[i], s.mem, mreq.size * i);
+        vkBindBufferMemory(dev, s.bufs[i], s.mem.mem, s.mem.offset + s.elemSize * i);
     }
 
-    s.elemSize = mreq.size;
-
     return s;
 }
\ No newline at end of file
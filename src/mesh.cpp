@@ -0,0 +1,137 @@
+#include "main.hpp"
+
+static constexpr VkDeviceSize vertStride = sizeof(pvert::vertex);
+static constexpr VkDeviceSize indexAlign = 4; // 16 and 32 bit indices share the buffer
+
+void appvk::createMeshPool(VkDeviceSize vertBytes, VkDeviceSize indexBytes) {
+    meshes.vert = createSharedBuffer(vertBytes,
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        vmem::category::mesh);
+
+    meshes.index = createSharedBuffer(indexBytes,
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+        vmem::category::mesh);
+
+    meshes.vertRange.emplace(vertBytes);
+    meshes.indexRange.emplace(indexBytes);
+}
+
+void appvk::destroyMeshPool() {
+    vkDestroyBuffer(dev, meshes.vert.buf, nullptr);
+    allocator.free(meshes.vert.mem);
+
+    vkDestroyBuffer(dev, meshes.index.buf, nullptr);
+    allocator.free(meshes.index.mem);
+
+    meshes = meshPool{};
+}
+
+// record copying a mesh into the pool and return its id
+uint32_t appvk::uploadMesh(uploadBatch& b, const pvert::view& v) {
+    VkDeviceSize vertBytes = v.vertexCount * vertStride;
+    VkDeviceSize indexBytes = v.indexCount * v.indexSize;
+
+    // aligning to the stride keeps offsets a whole number of elements
+    mesh m;
+    VkDeviceSize vertOffset, indexOffset;
+
+    m.vertHandle = meshes.vertRange->alloc(vertBytes, vertStride, vertOffset);
+    m.indexHandle = meshes.indexRange->alloc(indexBytes, indexAlign, indexOffset);
+
+    if (m.vertHandle == vmem::tlsf::invalid || m.indexHandle == vmem::tlsf::invalid) {
+        if (m.vertHandle != vmem::tlsf::invalid) {
+            meshes.vertRange->free(m.vertHandle);
+        }
+
+        if (m.indexHandle != vmem::tlsf::invalid) {
+            meshes.indexRange->free(m.indexHandle);
+        }
+
+        throw std::runtime_error("mesh pool is full!");
+    }
+
+    m.vertexCount = v.vertexCount;
+    m.indexCount = v.indexCount;
+    m.indexType = v.indexSize == 2 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+    m.vertexOffset = vertOffset / vertStride;
+    m.firstIndex = indexOffset / v.indexSize;
+    m.box = v.box;
+    m.lods = v.lods;
+    m.lodCount = v.lodCount;
+    m.live = true;
+
+    // the pool buffers are shared between queues, so there is nothing to hand over
+    stagingSlice vs = stageUpload(b, v.verts, vertBytes);
+    copyBuffer(b.cbuf, vs.buf, meshes.vert.buf, vertBytes, vs.offset, vertOffset);
+
+    stagingSlice is = stageUpload(b, v.indices, indexBytes);
+    copyBuffer(b.cbuf, is.buf, meshes.index.buf, indexBytes, is.offset, indexOffset);
+
+    for (size_t i = 0; i < meshes.meshes.size(); i++) {
+        if (!meshes.meshes[i].live) {
+            meshes.meshes[i] = m;
+            return i;
+        }
+    }
+
+    meshes.meshes.push_back(m);
+    return meshes.meshes.size() - 1;
+}
+
+// the mesh must not be used by any frame still in flight
+void appvk::freeMesh(uint32_t id) {
+    mesh& m = meshes.meshes[id];
+
+    meshes.vertRange->free(m.vertHandle);
+    meshes.indexRange->free(m.indexHandle);
+
+    m = mesh{};
+}
+
+// pack every live mesh to the front of a new pair of buffers so the free space is one contiguous range.
+// blocks until every frame in flight is done, so only do this after unloading a lot of meshes.
+void appvk::compactMeshPool() {
+    waitFrame(framesSubmitted);
+
+    for (uploadBatch& b : uploads) {
+        waitUpload(b);
+    }
+
+    uploads.clear();
+
+    meshPool old = std::move(meshes);
+    createMeshPool(old.vertRange->size(), old.indexRange->size());
+
+    uploadBatch b = beginUpload();
+
+    for (mesh m : old.meshes) {
+        if (m.live) {
+            VkDeviceSize vertBytes = m.vertexCount * vertStride;
+            VkDeviceSize indexSize = m.indexType == VK_INDEX_TYPE_UINT16 ? 2 : 4;
+            VkDeviceSize indexBytes = m.indexCount * indexSize;
+            VkDeviceSize vertOffset, indexOffset;
+
+            // both ranges start out empty and are filled in order, so these can't fail
+            m.vertHandle = meshes.vertRange->alloc(vertBytes, vertStride, vertOffset);
+            m.indexHandle = meshes.indexRange->alloc(indexBytes, indexAlign, indexOffset);
+
+            copyBuffer(b.cbuf, old.vert.buf, meshes.vert.buf, vertBytes, m.vertexOffset * vertStride, vertOffset);
+            copyBuffer(b.cbuf, old.index.buf, meshes.index.buf, indexBytes, m.firstIndex * indexSize, indexOffset);
+
+            m.vertexOffset = vertOffset / vertStride;
+            m.firstIndex = indexOffset / indexSize;
+        }
+
+        meshes.meshes.push_back(m); // ids don't change
+    }
+
+    waitUpload(b);
+    writeDrawInfo(); // offsets moved
+    sceneVersion++; // and the recorded draws bind the old buffers
+
+    vkDestroyBuffer(dev, old.vert.buf, nullptr);
+    allocator.free(old.vert.mem);
+
+    vkDestroyBuffer(dev, old.index.buf, nullptr);
+    allocator.free(old.index.mem);
+}
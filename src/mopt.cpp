@@ -0,0 +1,290 @@
+#include "mopt.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <cstring>
+
+#include "glm_mat_wrapper.hpp"
+
+namespace mopt {
+
+    static constexpr uint32_t none = UINT32_MAX;
+
+    // position is the first attribute of every vertex
+    static glm::vec3 position(const vformat::vertex& v) {
+        float p[3];
+        memcpy(p, &v, sizeof(p));
+        return glm::vec3(p[0], p[1], p[2]);
+    }
+
+    metrics measure(const std::vector<uint32_t>& indices, size_t vertexCount) {
+        metrics m;
+        if (indices.empty() || vertexCount == 0) {
+            return m;
+        }
+
+        // a vertex is in the cache if it was pushed fewer than cacheSize misses ago
+        std::vector<uint32_t> pushedAt(vertexCount, none);
+        uint32_t misses = 0;
+        size_t used = 0;
+
+        for (uint32_t i : indices) {
+            if (pushedAt[i] == none) {
+                used++;
+            }
+
+            if (pushedAt[i] == none || misses - pushedAt[i] >= cacheSize) {
+                pushedAt[i] = misses++;
+            }
+        }
+
+        m.acmr = float(misses) / (indices.size() / 3);
+        m.atvr = float(misses) / used;
+        return m;
+    }
+
+    // Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw", 2007.
+    // fans around one vertex at a time, moving on to whichever recently used vertex will still be in the cache.
+    // clusters, if given, gets the first triangle of every run that had to restart from a dead end.
+    void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, std::vector<uint32_t>* clusters) {
+        size_t triCount = indices.size() / 3;
+        if (triCount == 0) {
+            return;
+        }
+
+        // triangles using each vertex, as offsets into one flat list
+        std::vector<uint32_t> live(vertexCount, 0);
+        for (uint32_t i : indices) {
+            live[i]++;
+        }
+
+        std::vector<uint32_t> adjOffset(vertexCount + 1, 0);
+        for (size_t v = 0; v < vertexCount; v++) {
+            adjOffset[v + 1] = adjOffset[v] + live[v];
+        }
+
+        std::vector<uint32_t> adj(indices.size());
+        std::vector<uint32_t> fill(adjOffset.begin(), adjOffset.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++) {
+            adj[fill[indices[i]]++] = i / 3;
+        }
+
+        std::vector<uint32_t> cacheTime(vertexCount, 0);
+        std::vector<bool> emitted(triCount, false);
+        std::vector<uint32_t> deadEnd;
+        std::vector<uint32_t> candidates;
+        std::vector<uint32_t> out;
+        out.reserve(indices.size());
+
+        uint32_t time = cacheSize + 1;
+        uint32_t cursor = 0;
+        uint32_t fan = 0;
+
+        if (clusters) {
+            clusters->assign(1, 0);
+        }
+
+        while (fan != none) {
+            candidates.clear();
+
+            for (uint32_t a = adjOffset[fan]; a < adjOffset[fan + 1]; a++) {
+                uint32_t t = adj[a];
+                if (emitted[t]) {
+                    continue;
+                }
+
+                for (int k = 0; k < 3; k++) {
+                    uint32_t v = indices[t * 3 + k];
+                    out.push_back(v);
+                    deadEnd.push_back(v);
+                    candidates.push_back(v);
+                    live[v]--;
+
+                    if (time - cacheTime[v] > cacheSize) {
+                        cacheTime[v] = time++;
+                    }
+                }
+
+                emitted[t] = true;
+            }
+
+            // prefer the candidate that's been in the cache longest but will still be there after fanning around it
+            uint32_t next = none;
+            int best = -1;
+            for (uint32_t v : candidates) {
+                if (live[v] == 0) {
+                    continue;
+                }
+
+                int priority = 0;
+                if (time - cacheTime[v] + 2 * live[v] <= cacheSize) {
+                    priority = time - cacheTime[v];
+                }
+
+                if (priority > best) {
+                    best = priority;
+                    next = v;
+                }
+            }
+
+            if (next == none) {
+                // dead end, fall back to recently used vertices and then to the input order
+                while (!deadEnd.empty() && next == none) {
+                    uint32_t v = deadEnd.back();
+                    deadEnd.pop_back();
+                    if (live[v] > 0) {
+                        next = v;
+                    }
+                }
+
+                while (cursor < vertexCount && next == none) {
+                    if (live[cursor] > 0) {
+                        next = cursor;
+                    }
+
+                    cursor++;
+                }
+
+                if (clusters && next != none) {
+                    clusters->push_back(out.size() / 3);
+                }
+            }
+
+            fan = next;
+        }
+
+        indices.swap(out);
+    }
+
+    // splits each cluster further wherever the cache has warmed up enough that cutting there costs little,
+    // then sorts clusters so the ones facing away from the mesh centre, which are likely in front, draw first
+    void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<vformat::vertex>& verts, const std::vector<uint32_t>& clusters) {
+        size_t triCount = indices.size() / 3;
+        if (triCount == 0 || clusters.empty()) {
+            return;
+        }
+
+        // soft boundaries, same idea as the paper's lambda threshold
+        constexpr float threshold = 1.05f;
+        float target = measure(indices, verts.size()).acmr * threshold;
+
+        // misses is never reset. each cluster starts with an empty cache by ignoring anything pushed before its base,
+        // so splitting costs nothing no matter how many vertices there are
+        std::vector<uint32_t> starts;
+        std::vector<uint32_t> pushedAt(verts.size(), none);
+        uint32_t misses = 0;
+        for (size_t c = 0; c < clusters.size(); c++) {
+            uint32_t begin = clusters[c];
+            uint32_t end = c + 1 < clusters.size() ? clusters[c + 1] : triCount;
+
+            starts.push_back(begin);
+            uint32_t base = misses;
+            uint32_t tris = 0;
+
+            for (uint32_t t = begin; t < end; t++) {
+                for (int k = 0; k < 3; k++) {
+                    uint32_t v = indices[t * 3 + k];
+                    if (pushedAt[v] == none || pushedAt[v] < base || misses - pushedAt[v] >= cacheSize) {
+                        pushedAt[v] = misses++;
+                    }
+                }
+
+                tris++;
+                if (t + 1 < end && float(misses - base) / tris <= target) {
+                    starts.push_back(t + 1);
+                    base = misses;
+                    tris = 0;
+                }
+            }
+        }
+
+        // area weighted centroid of the whole mesh and of each cluster
+        glm::vec3 meshCentre(0.0f);
+        float meshArea = 0.0f;
+        for (size_t t = 0; t < triCount; t++) {
+            glm::vec3 a = position(verts[indices[t * 3]]);
+            glm::vec3 b = position(verts[indices[t * 3 + 1]]);
+            glm::vec3 c = position(verts[indices[t * 3 + 2]]);
+            float area = glm::length(glm::cross(b - a, c - a));
+
+            meshCentre += (a + b + c) * (area / 3.0f);
+            meshArea += area;
+        }
+
+        if (meshArea > 0.0f) {
+            meshCentre /= meshArea;
+        }
+
+        std::vector<float> sortKey(starts.size());
+        for (size_t c = 0; c < starts.size(); c++) {
+            uint32_t end = c + 1 < starts.size() ? starts[c + 1] : triCount;
+
+            glm::vec3 centre(0.0f);
+            glm::vec3 normal(0.0f); // unnormalised cross products, so this is area weighted too
+            float area = 0.0f;
+
+            for (uint32_t t = starts[c]; t < end; t++) {
+                glm::vec3 a = position(verts[indices[t * 3]]);
+                glm::vec3 b = position(verts[indices[t * 3 + 1]]);
+                glm::vec3 d = position(verts[indices[t * 3 + 2]]);
+                glm::vec3 n = glm::cross(b - a, d - a);
+                float triArea = glm::length(n);
+
+                centre += (a + b + d) * (triArea / 3.0f);
+                normal += n;
+                area += triArea;
+            }
+
+            if (area > 0.0f) {
+                centre /= area;
+            }
+
+            float len = glm::length(normal);
+            sortKey[c] = len > 0.0f ? glm::dot(centre - meshCentre, normal / len) : 0.0f;
+        }
+
+        std::vector<uint32_t> order(starts.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return sortKey[a] > sortKey[b]; });
+
+        std::vector<uint32_t> out;
+        out.reserve(indices.size());
+        for (uint32_t c : order) {
+            uint32_t end = c + 1 < starts.size() ? starts[c + 1] : triCount;
+            out.insert(out.end(), indices.begin() + starts[c] * 3, indices.begin() + end * 3);
+        }
+
+        indices.swap(out);
+    }
+
+    // renumbers vertices in order of first use and drops any that aren't referenced
+    void optimizeVertexFetch(std::vector<vformat::vertex>& verts, std::vector<uint32_t>& indices) {
+        std::vector<uint32_t> remap(verts.size(), none);
+        std::vector<vformat::vertex> out;
+        out.reserve(verts.size());
+
+        for (uint32_t& i : indices) {
+            if (remap[i] == none) {
+                remap[i] = out.size();
+                out.push_back(verts[i]);
+            }
+
+            i = remap[i];
+        }
+
+        verts.swap(out);
+    }
+
+    report optimize(std::vector<vformat::vertex>& verts, std::vector<uint32_t>& indices) {
+        report r;
+        r.before = measure(indices, verts.size());
+
+        std::vector<uint32_t> clusters;
+        optimizeVertexCache(indices, verts.size(), &clusters);
+        optimizeOverdraw(indices, verts, clusters);
+        optimizeVertexFetch(verts, indices);
+
+        r.after = measure(indices, verts.size());
+        return r;
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "vformat.hpp"
+
+// Load time mesh optimisation.
+// Triangles are reordered for the post-transform vertex cache (Tipsify), clusters of them are then sorted to draw
+// outward facing geometry first to cut overdraw, and finally vertices are renumbered in the order they're used so
+// vertex fetch walks memory linearly. Only the order changes, so the output renders the same.
+namespace mopt {
+
+    // the cache size used when reordering. smaller than real hardware so it holds up across vendors.
+    constexpr uint32_t cacheSize = 16;
+
+    struct metrics {
+        float acmr = 0.0f; // average cache miss ratio, vertex shader runs per triangle. 0.5 is ideal, 3 is worst
+        float atvr = 0.0f; // average transform to vertex ratio, vertex shader runs per vertex. 1 is ideal
+    };
+
+    // simulates a FIFO cache of cacheSize entries
+    metrics measure(const std::vector<uint32_t>& indices, size_t vertexCount);
+
+    void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, std::vector<uint32_t>* clusters = nullptr);
+    void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<vformat::vertex>& verts, const std::vector<uint32_t>& clusters);
+    void optimizeVertexFetch(std::vector<vformat::vertex>& verts, std::vector<uint32_t>& indices);
+
+    struct report {
+        metrics before;
+        metrics after;
+    };
+
+    // runs all of the above in order
+    report optimize(std::vector<vformat::vertex>& verts, std::vector<uint32_t>& indices);
+
+    // quadric error edge collapse down to about targetIndexCount indices. the result uses the same vertices,
+    // error is roughly how far the simplified surface is from the original in object space units
+    std::vector<uint32_t> simplify(const std::vector<vformat::vertex>& verts, const std::vector<uint32_t>& indices,
+        size_t targetIndexCount, float& error);
+
+    // levels stop halving once they'd be smaller than this
+    constexpr size_t minLodTriangles = 64;
+
+    struct level {
+        std::vector<uint32_t> indices;
+        float error = 0.0f;
+    };
+
+    // level 0 is indices unchanged, each level after has about half the triangles of the one before.
+    // the extra levels are reordered for the vertex cache too.
+    std::vector<level> buildLods(const std::vector<vformat::vertex>& verts, const std::vector<uint32_t>& indices, size_t maxLevels);
+}
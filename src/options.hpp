@@ -8,8 +8,34 @@ namespace options {
     constexpr unsigned int msaaSamples = 2;
     constexpr bool rayTracing = true;
 
+    // copies of the object, instanceGrid x instanceGrid of them instanceSpacing apart
+    constexpr unsigned int instanceGrid = 32;
+    constexpr float instanceSpacing = 3.0f;
+    constexpr unsigned int instanceCapacity = 16 * 1024;
+
+    // highest simplification error, in pixels, a level of detail may show before a finer one is used
+    constexpr float lodErrorPixels = 1.0f;
+
+    // threads recording draws into secondary command buffers
+    constexpr unsigned int recordThreads = 4;
+
+    // bytes of uniform data each frame in flight can write
+    constexpr unsigned int uniformRegionSize = 64 * 1024;
+
+    // capacity of the shared vertex and index buffers
+    constexpr unsigned long long meshVertexBytes = 64ull * 1024 * 1024;
+    constexpr unsigned long long meshIndexBytes = 16ull * 1024 * 1024;
+
+    // the staging arena grows in chunks of at least this many bytes
+    constexpr unsigned long long stagingChunkSize = 32ull * 1024 * 1024;
+
+    // timestamp scopes a frame can open, and how many frames the overlay's min / avg / max cover
+    constexpr unsigned int profilerScopes = 32;
+    constexpr unsigned int profilerHistory = 120;
+
     // dev options
-    constexpr unsigned int framesInFlight = 2;
+    constexpr unsigned int framesInFlight = 2; // default, can be changed while running
+    constexpr unsigned int maxFramesInFlight = 4; // everything per frame in flight is allocated for this many
     constexpr bool verbose = false;
     constexpr bool shaderDebug = false;
 
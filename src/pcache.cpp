@@ -0,0 +1,164 @@
+#include "main.hpp"
+
+#include "options.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+
+#include <sys/stat.h>
+
+static constexpr const char* pipelineCacheDir = "cache";
+static constexpr const char* pipelineCachePath = "cache/pipelines.bin";
+
+// the driver is supposed to reject data that isn't its own, but not every one does so gracefully
+static bool compatibleCache(const std::vector<char>& data, const VkPhysicalDeviceProperties& dprop) {
+    constexpr size_t headerSize = 4 * sizeof(uint32_t) + VK_UUID_SIZE;
+    if (data.size() < headerSize) {
+        return false;
+    }
+
+    uint32_t fields[4];
+    memcpy(fields, data.data(), sizeof(fields));
+
+    return fields[0] >= headerSize && fields[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+        fields[2] == dprop.vendorID && fields[3] == dprop.deviceID &&
+        memcmp(data.data() + sizeof(fields), dprop.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+void appvk::createPipelineCache() {
+    VkPhysicalDeviceProperties dprop;
+    vkGetPhysicalDeviceProperties(pdev, &dprop);
+
+    std::vector<char> data;
+    std::ifstream in(pipelineCachePath, std::ios::binary | std::ios::ate);
+    if (in) {
+        data.resize(size_t(in.tellg()));
+        in.seekg(0);
+        in.read(data.data(), data.size());
+
+        if (!in || !compatibleCache(data, dprop)) {
+            cout << "pipeline cache is from another driver or device, starting cold\n";
+            data.clear();
+        }
+    }
+
+    VkPipelineCacheCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    createInfo.initialDataSize = data.size();
+    createInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+    if (vkCreatePipelineCache(dev, &createInfo, nullptr, &pipeCache) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create pipeline cache!");
+    }
+
+    pipeCacheLoaded = data.size();
+}
+
+// called once the device is idle, before the cache is destroyed
+void appvk::savePipelineCache() {
+    size_t size = 0;
+    if (vkGetPipelineCacheData(dev, pipeCache, &size, nullptr) != VK_SUCCESS || size == 0) {
+        return;
+    }
+
+    std::vector<char> data(size);
+    if (vkGetPipelineCacheData(dev, pipeCache, &size, data.data()) != VK_SUCCESS) {
+        return;
+    }
+
+    mkdir(pipelineCacheDir, 0755);
+
+    // write to a temporary and rename, so a crash or a second instance never sees half a file
+    std::string tmp = std::string(pipelineCachePath) + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        out.write(data.data(), size);
+
+        if (!out) {
+            out.close();
+            std::remove(tmp.c_str());
+            return;
+        }
+    }
+
+    std::rename(tmp.c_str(), pipelineCachePath);
+}
+
+// every pipeline is built through one of these so they all share pipeCache and get timed
+VkResult appvk::buildPipelines(uint32_t count, const VkGraphicsPipelineCreateInfo* infos, VkPipeline* pipes) {
+    auto start = std::chrono::steady_clock::now();
+    VkResult r = vkCreateGraphicsPipelines(dev, pipeCache, count, infos, nullptr, pipes);
+
+    float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::lock_guard<std::mutex> lock(pipelineStatsLock);
+    pipelineMs += ms;
+    pipelineCount += count;
+    return r;
+}
+
+VkResult appvk::buildPipelines(uint32_t count, const VkComputePipelineCreateInfo* infos, VkPipeline* pipes) {
+    auto start = std::chrono::steady_clock::now();
+    VkResult r = vkCreateComputePipelines(dev, pipeCache, count, infos, nullptr, pipes);
+
+    float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::lock_guard<std::mutex> lock(pipelineStatsLock);
+    pipelineMs += ms;
+    pipelineCount += count;
+    return r;
+}
+
+// vkCreate*Pipelines and the cache are safe to use from any thread, so a job needs nothing but what it captures
+std::shared_future<void> appvk::buildAsync(std::function<void()> job) {
+    std::shared_future<void> f = buildPool->async(std::move(job)).share();
+    pendingPipelines.push_back(f);
+    return f;
+}
+
+std::shared_future<void> appvk::buildComputeAsync(std::string spvPath, VkPipelineLayout layout, VkPipeline* pipe, std::string name) {
+    return buildAsync([this, spvPath = std::move(spvPath), layout, pipe, name = std::move(name)] {
+        std::vector<char> cspv = readFile(spvPath);
+        VkShaderModule cmod = createShaderModule(cspv);
+
+        VkComputePipelineCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        createInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        createInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        createInfo.stage.module = cmod;
+        createInfo.stage.pName = "main";
+        createInfo.layout = layout;
+
+        VkResult r = buildPipelines(1, &createInfo, pipe);
+        vkDestroyShaderModule(dev, cmod, nullptr);
+
+        if (r != VK_SUCCESS) {
+            throw std::runtime_error("cannot create " + name + " pipeline!");
+        }
+    });
+}
+
+// every pending build is waited for even if one of them failed, so none is left running while the error unwinds
+void appvk::waitPipelines() {
+    auto start = std::chrono::steady_clock::now();
+
+    std::exception_ptr error;
+    for (std::shared_future<void>& f : pendingPipelines) {
+        try {
+            f.get();
+        } catch (...) {
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+    }
+
+    pendingPipelines.clear();
+    pipelineWaitMs += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
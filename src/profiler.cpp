@@ -0,0 +1,214 @@
+#include "main.hpp"
+
+#include "options.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+void appvk::createProfiler() {
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(pdev, &familyCount, nullptr);
+    prof.families.resize(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(pdev, &familyCount, prof.families.data());
+
+    VkPhysicalDeviceProperties dprop;
+    vkGetPhysicalDeviceProperties(pdev, &dprop);
+    prof.period = dprop.limits.timestampPeriod;
+
+    // frames are only timed if the graphics queue can write timestamps
+    if (prof.families[gQueueFamily].timestampValidBits == 0) {
+        return;
+    }
+
+    VkQueryPoolCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    createInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    createInfo.queryCount = 2 * options::profilerScopes;
+
+    prof.frames.resize(options::maxFramesInFlight);
+    for (profilerFrame& f : prof.frames) {
+        if (vkCreateQueryPool(dev, &createInfo, nullptr, &f.pool) != VK_SUCCESS) {
+            throw std::runtime_error("cannot create profiler query pool!");
+        }
+    }
+}
+
+void appvk::destroyProfiler() {
+    for (profilerFrame& f : prof.frames) {
+        vkDestroyQueryPool(dev, f.pool, nullptr);
+    }
+
+    prof.frames.clear();
+}
+
+// readProfilerFrame has already taken what the last frame in this slot wrote
+void appvk::beginProfilerFrame(VkCommandBuffer cbuf) {
+    if (prof.frames.empty()) {
+        return;
+    }
+
+    profilerFrame& f = prof.frames[currFrame];
+    f.scopes.clear();
+    f.open.clear();
+    f.recorded = false;
+
+    vkCmdResetQueryPool(cbuf, f.pool, 0, 2 * options::profilerScopes);
+}
+
+void appvk::readProfilerFrame(uint32_t frame) {
+    if (prof.frames.empty() || !prof.frames[frame].recorded) {
+        return;
+    }
+
+    profilerFrame& f = prof.frames[frame];
+    f.recorded = false;
+
+    // the frame is done, so this doesn't wait. a scope left open makes it NOT_READY, and the frame is skipped
+    std::vector<uint64_t> ticks(2 * f.scopes.size());
+    if (vkGetQueryPoolResults(dev, f.pool, 0, ticks.size(), ticks.size() * sizeof(uint64_t), ticks.data(),
+        sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+        return;
+    }
+
+    // scopes with a parent go last, so the first time round the parent is already there to be placed under
+    for (bool parented : {false, true}) {
+        for (const gpuScope& s : f.scopes) {
+            if ((s.parent != nullptr) == parented) {
+                addScopeTime(s.name, s.depth, tickMs(ticks[s.query], ticks[s.query + 1], gQueueFamily), s.parent);
+            }
+        }
+    }
+}
+
+// both ends are written once everything recorded before them has finished, so a scope covers the work recorded
+// inside it and nested scopes add up to at most their parent. without a parent the scope nests in whichever is open,
+// a secondary that is recorded before the primary gets to where it runs names the scope it runs in instead.
+void appvk::beginScope(VkCommandBuffer cbuf, const char* name, const char* parent) {
+    if (prof.frames.empty()) {
+        return;
+    }
+
+    profilerFrame& f = prof.frames[currFrame];
+
+    // past the pool's size the scope is dropped, but still has to be closed
+    if (f.scopes.size() == options::profilerScopes) {
+        f.open.push_back(UINT32_MAX);
+        return;
+    }
+
+    gpuScope s{name, parent, uint32_t(f.open.size()), uint32_t(2 * f.scopes.size())};
+    vkCmdWriteTimestamp(cbuf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, f.pool, s.query);
+
+    f.open.push_back(f.scopes.size());
+    f.scopes.push_back(s);
+}
+
+void appvk::endScope(VkCommandBuffer cbuf) {
+    if (prof.frames.empty()) {
+        return;
+    }
+
+    profilerFrame& f = prof.frames[currFrame];
+    uint32_t i = f.open.back();
+    f.open.pop_back();
+
+    if (i != UINT32_MAX) {
+        vkCmdWriteTimestamp(cbuf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, f.pool, f.scopes[i].query + 1);
+        f.recorded = true;
+    }
+}
+
+// transfer queues can't reset queries, so those are only timed if the pool can be reset on the host
+appvk::gpuTimer appvk::beginTimer(VkCommandBuffer cbuf, uint32_t family, const char* name) {
+    gpuTimer timer;
+    timer.name = name;
+    timer.family = family;
+
+    const VkQueueFamilyProperties& props = prof.families[family];
+    bool cmdReset = props.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT);
+    if (props.timestampValidBits == 0 || (!hostQueryReset && !cmdReset)) {
+        return timer;
+    }
+
+    VkQueryPoolCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    createInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    createInfo.queryCount = 2;
+
+    if (vkCreateQueryPool(dev, &createInfo, nullptr, &timer.pool) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create timer query pool!");
+    }
+
+    if (hostQueryReset) {
+        vkResetQueryPool(dev, timer.pool, 0, 2);
+    } else {
+        vkCmdResetQueryPool(cbuf, timer.pool, 0, 2);
+    }
+
+    vkCmdWriteTimestamp(cbuf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timer.pool, 0);
+    return timer;
+}
+
+void appvk::endTimer(VkCommandBuffer cbuf, const gpuTimer& timer) {
+    if (timer.pool) {
+        vkCmdWriteTimestamp(cbuf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timer.pool, 1);
+    }
+}
+
+void appvk::readTimer(gpuTimer& timer) {
+    if (!timer.pool) {
+        return;
+    }
+
+    uint64_t ticks[2];
+    if (vkGetQueryPoolResults(dev, timer.pool, 0, 2, sizeof(ticks), ticks, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+        addScopeTime(timer.name, 0, tickMs(ticks[0], ticks[1], timer.family));
+    }
+
+    vkDestroyQueryPool(dev, timer.pool, nullptr);
+    timer.pool = VK_NULL_HANDLE;
+}
+
+// scopes are told apart by name and depth. a new one goes at the end, or after everything under its parent
+void appvk::addScopeTime(const char* name, uint32_t depth, float ms, const char* parent) {
+    size_t at = prof.scopes.size();
+
+    if (parent) {
+        auto p = std::find_if(prof.scopes.begin(), prof.scopes.end(), [&](const scopeHistory& h) {
+            return std::strcmp(h.name, parent) == 0;
+        });
+
+        if (p != prof.scopes.end()) {
+            depth = p->depth + 1;
+            at = p - prof.scopes.begin() + 1;
+            while (at < prof.scopes.size() && prof.scopes[at].depth >= depth) {
+                at++;
+            }
+        } else {
+            depth = 0; // the parent was never timed
+        }
+    }
+
+    auto it = std::find_if(prof.scopes.begin(), prof.scopes.end(), [&](const scopeHistory& h) {
+        return h.depth == depth && std::strcmp(h.name, name) == 0;
+    });
+
+    if (it == prof.scopes.end()) {
+        it = prof.scopes.insert(prof.scopes.begin() + at, {name, depth, {}, 0});
+    }
+
+    if (it->ms.size() < options::profilerHistory) {
+        it->ms.push_back(ms);
+    } else {
+        it->ms[it->next] = ms;
+    }
+
+    it->next = (it->next + 1) % options::profilerHistory;
+}
+
+// the counter wraps at timestampValidBits
+float appvk::tickMs(uint64_t begin, uint64_t end, uint32_t family) {
+    uint32_t bits = prof.families[family].timestampValidBits;
+    uint64_t mask = (bits >= 64) ? ~0ull : (1ull << bits) - 1;
+    return float((end - begin) & mask) * prof.period / 1e6f;
+}
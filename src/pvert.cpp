@@ -0,0 +1,134 @@
+#include "pvert.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace pvert {
+
+    static int16_t snorm16(float v) {
+        return int16_t(std::lround(std::clamp(v, -1.0f, 1.0f) * 32767.0f));
+    }
+
+    // round to nearest, uvs never get near the denormal or overflow range so those just flush or clamp
+    static uint16_t half(float v) {
+        uint32_t bits;
+        memcpy(&bits, &v, sizeof(bits));
+
+        uint32_t sign = (bits >> 16) & 0x8000;
+        int32_t exp = int32_t((bits >> 23) & 0xff) - 127 + 15;
+        uint32_t mant = bits & 0x7fffff;
+
+        if (exp <= 0) {
+            return sign;
+        } else if (exp >= 31) {
+            return sign | 0x7bff;
+        }
+
+        uint32_t h = sign | (exp << 10) | (mant >> 13);
+        if (mant & 0x1000) {
+            h++; // carries into the exponent correctly
+        }
+
+        return std::min<uint32_t>(h, sign | 0x7bff);
+    }
+
+    // maps the unit sphere onto a square, folding the lower hemisphere over the diagonals
+    static void octahedral(const float n[3], int16_t out[2]) {
+        float len = std::fabs(n[0]) + std::fabs(n[1]) + std::fabs(n[2]);
+        if (len == 0.0f) {
+            out[0] = out[1] = 0;
+            return;
+        }
+
+        float x = n[0] / len;
+        float y = n[1] / len;
+
+        if (n[2] < 0.0f) {
+            float fx = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+            float fy = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+            x = fx;
+            y = fy;
+        }
+
+        out[0] = snorm16(x);
+        out[1] = snorm16(y);
+    }
+
+    packed pack(const std::vector<vformat::vertex>& verts, const std::vector<uint32_t>& indices, const std::vector<lod>& lods) {
+        packed p;
+
+        // vformat::vertex is 4 attributes each starting on a 16 byte boundary: position, normal, uv, tangent
+        auto attr = [](const vformat::vertex& v, size_t i, float* out, size_t count) {
+            memcpy(out, reinterpret_cast<const char*>(&v) + 16 * i, count * sizeof(float));
+        };
+
+        std::fill(p.box.min, p.box.min + 3, verts.empty() ? 0.0f : INFINITY);
+        std::fill(p.box.max, p.box.max + 3, verts.empty() ? 0.0f : -INFINITY);
+        for (const vformat::vertex& v : verts) {
+            float pos[3];
+            attr(v, 0, pos, 3);
+
+            for (int i = 0; i < 3; i++) {
+                p.box.min[i] = std::min(p.box.min[i], pos[i]);
+                p.box.max[i] = std::max(p.box.max[i], pos[i]);
+            }
+        }
+
+        float centre[3], extent[3];
+        for (int i = 0; i < 3; i++) {
+            centre[i] = (p.box.min[i] + p.box.max[i]) * 0.5f;
+            extent[i] = (p.box.max[i] - p.box.min[i]) * 0.5f;
+        }
+
+        p.verts.resize(verts.size());
+        for (size_t i = 0; i < verts.size(); i++) {
+            float pos[3], normal[3], uv[2], tangent[3];
+            attr(verts[i], 0, pos, 3);
+            attr(verts[i], 1, normal, 3);
+            attr(verts[i], 2, uv, 2);
+            attr(verts[i], 3, tangent, 3);
+
+            vertex& out = p.verts[i];
+            for (int k = 0; k < 3; k++) {
+                out.pos[k] = extent[k] > 0.0f ? snorm16((pos[k] - centre[k]) / extent[k]) : 0;
+            }
+
+            out.pos[3] = 0;
+            octahedral(normal, out.normal);
+            out.uv[0] = half(uv[0]);
+            out.uv[1] = half(uv[1]);
+            octahedral(tangent, out.tangent);
+        }
+
+        // ranges are repacked from 0 so the dropped levels' indices aren't kept
+        p.lodCount = std::min(lods.size(), maxLods);
+        for (uint32_t l = 0; l < p.lodCount; l++) {
+            p.lods[l].firstIndex = p.indexCount;
+            p.lods[l].indexCount = lods[l].indexCount;
+            p.lods[l].error = lods[l].error;
+            p.indexCount += lods[l].indexCount;
+        }
+
+        p.indexSize = verts.size() <= UINT16_MAX + 1 ? 2 : 4;
+        p.indices.resize(p.indexCount * p.indexSize);
+
+        uint8_t* out = p.indices.data();
+        for (uint32_t l = 0; l < p.lodCount; l++) {
+            const uint32_t* first = indices.data() + lods[l].firstIndex;
+
+            if (p.indexSize == 2) {
+                for (uint32_t k = 0; k < lods[l].indexCount; k++) {
+                    uint16_t ix = first[k];
+                    memcpy(out, &ix, 2);
+                    out += 2;
+                }
+            } else {
+                memcpy(out, first, lods[l].indexCount * 4);
+                out += lods[l].indexCount * 4;
+            }
+        }
+
+        return p;
+    }
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "glfw_wrapper.hpp"
+
+#include <array>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "vformat.hpp"
+
+// Packed vertex format, 20 bytes instead of vformat::vertex's 64.
+// position is snorm16 relative to the mesh bounds, normal and tangent are octahedral snorm16x2, uvs are half floats.
+// the pipeline's vertex input state is generated from the attribute table below, keep shader.vert's inputs in the
+// same order.
+namespace pvert {
+
+    struct vertex {
+        int16_t pos[4]; // w is padding
+        int16_t normal[2];
+        uint16_t uv[2];
+        int16_t tangent[2];
+    };
+
+    struct attribute {
+        uint32_t location;
+        VkFormat format;
+        uint32_t offset;
+    };
+
+    constexpr std::array<attribute, 4> attributes = {{
+        {0, VK_FORMAT_R16G16B16A16_SNORM, offsetof(vertex, pos)},
+        {1, VK_FORMAT_R16G16_SNORM, offsetof(vertex, normal)},
+        {2, VK_FORMAT_R16G16_SFLOAT, offsetof(vertex, uv)},
+        {3, VK_FORMAT_R16G16_SNORM, offsetof(vertex, tangent)},
+    }};
+
+    constexpr uint32_t formatSize(VkFormat f) {
+        switch (f) {
+        case VK_FORMAT_R16G16_SNORM:
+        case VK_FORMAT_R16G16_SFLOAT:
+            return 4;
+        case VK_FORMAT_R16G16B16A16_SNORM:
+            return 8;
+        default:
+            return 0;
+        }
+    }
+
+    // every attribute has a known size, fits in the vertex and doesn't overlap the next
+    constexpr bool validLayout() {
+        for (size_t i = 0; i < attributes.size(); i++) {
+            uint32_t end = attributes[i].offset + formatSize(attributes[i].format);
+            if (formatSize(attributes[i].format) == 0 || end > sizeof(vertex) || attributes[i].location != i) {
+                return false;
+            }
+
+            if (i + 1 < attributes.size() && end > attributes[i + 1].offset) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    static_assert(validLayout(), "pvert::attributes doesn't match pvert::vertex");
+
+    constexpr VkVertexInputBindingDescription bindingDescription(uint32_t binding) {
+        return {binding, sizeof(vertex), VK_VERTEX_INPUT_RATE_VERTEX};
+    }
+
+    constexpr std::array<VkVertexInputAttributeDescription, attributes.size()> attributeDescriptions(uint32_t binding) {
+        std::array<VkVertexInputAttributeDescription, attributes.size()> desc = {};
+        for (size_t i = 0; i < attributes.size(); i++) {
+            desc[i] = {attributes[i].location, binding, attributes[i].format, attributes[i].offset};
+        }
+
+        return desc;
+    }
+
+    // object space box the positions were quantised against, the shader gets it back as centre + extent
+    struct bounds {
+        float min[3] = {};
+        float max[3] = {};
+    };
+
+    // every level of detail indexes the same vertices, their indices are stored one after another
+    constexpr size_t maxLods = 4;
+
+    struct lod {
+        uint32_t firstIndex = 0; // from the mesh's first index
+        uint32_t indexCount = 0;
+        float error = 0.0f; // object space distance from the full detail surface
+    };
+
+    // a packed mesh somewhere in memory, either owned by a packed or mapped from the mesh cache
+    struct view {
+        const vertex* verts = nullptr;
+        uint32_t vertexCount = 0;
+        const void* indices = nullptr;
+        uint32_t indexCount = 0; // all levels together
+        uint32_t indexSize = 4; // 2 when every index fits in 16 bits
+        bounds box;
+        std::array<lod, maxLods> lods = {};
+        uint32_t lodCount = 0;
+    };
+
+    struct packed {
+        std::vector<vertex> verts;
+        std::vector<uint8_t> indices;
+        uint32_t indexCount = 0;
+        uint32_t indexSize = 4;
+        bounds box;
+        std::array<lod, maxLods> lods = {};
+        uint32_t lodCount = 0;
+
+        view get() const {
+            return {verts.data(), uint32_t(verts.size()), indices.data(), indexCount, indexSize, box, lods, lodCount};
+        }
+    };
+
+    // indices holds every level one after another as lods describes them, levels past maxLods are dropped
+    packed pack(const std::vector<vformat::vertex>& verts, const std::vector<uint32_t>& indices, const std::vector<lod>& lods);
+}
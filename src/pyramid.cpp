@@ -0,0 +1,224 @@
+#include "main.hpp"
+
+#include <cmath>
+
+// matches the push constants in pyramid.comp
+struct pyramidConstants {
+    int32_t srcSize[2];
+    int32_t dstSize[2];
+    int32_t samples;
+    uint32_t first;
+};
+
+// everything that doesn't depend on the swapchain
+void appvk::createPyramidPipeline() {
+    VkSamplerCreateInfo sampCreateInfo{};
+    sampCreateInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampCreateInfo.magFilter = VK_FILTER_NEAREST;
+    sampCreateInfo.minFilter = VK_FILTER_NEAREST;
+    sampCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampCreateInfo.minLod = 0.0f;
+    sampCreateInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+    if (vkCreateSampler(dev, &sampCreateInfo, nullptr, &hiz.samp) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create depth pyramid sampler!");
+    }
+
+    std::array<VkDescriptorSetLayoutBinding, 3> bindings = {};
+    for (size_t i = 0; i < bindings.size(); i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER; // multisampled depth
+
+    VkDescriptorSetLayoutCreateInfo layoutCreateInfo{};
+    layoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutCreateInfo.bindingCount = bindings.size();
+    layoutCreateInfo.pBindings = bindings.data();
+
+    if (vkCreateDescriptorSetLayout(dev, &layoutCreateInfo, nullptr, &hiz.layout) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create depth pyramid descriptor set layout!");
+    }
+
+    VkPushConstantRange pcr{};
+    pcr.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pcr.offset = 0;
+    pcr.size = sizeof(pyramidConstants);
+
+    VkPipelineLayoutCreateInfo pipeLayoutCreateInfo{};
+    pipeLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeLayoutCreateInfo.setLayoutCount = 1;
+    pipeLayoutCreateInfo.pSetLayouts = &hiz.layout;
+    pipeLayoutCreateInfo.pushConstantRangeCount = 1;
+    pipeLayoutCreateInfo.pPushConstantRanges = &pcr;
+
+    if (vkCreatePipelineLayout(dev, &pipeLayoutCreateInfo, nullptr, &hiz.pipeLayout) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create depth pyramid pipeline layout!");
+    }
+
+    buildComputeAsync(".spv/pyramid.comp.spv", hiz.pipeLayout, &hiz.pipe, "depth pyramid");
+}
+
+void appvk::destroyPyramidPipeline() {
+    vkDestroyPipeline(dev, hiz.pipe, nullptr);
+    vkDestroyPipelineLayout(dev, hiz.pipeLayout, nullptr);
+    vkDestroyDescriptorSetLayout(dev, hiz.layout, nullptr);
+    vkDestroySampler(dev, hiz.samp, nullptr);
+}
+
+// needs depth
+void appvk::createDepthPyramid() {
+    hiz.width = swapExtent.width;
+    hiz.height = swapExtent.height;
+    uint32_t levels = uint32_t(std::floor(std::log2(std::max(hiz.width, hiz.height)))) + 1;
+
+    hiz.im = createImage(hiz.width, hiz.height, VK_FORMAT_R32_SFLOAT, levels, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_TILING_OPTIMAL,
+        VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vmem::category::attachment);
+    hiz.im.view = createImageView(hiz.im.im, VK_FORMAT_R32_SFLOAT, levels, VK_IMAGE_ASPECT_COLOR_BIT);
+
+    // storage images can only be bound one level at a time
+    hiz.views.resize(levels);
+    for (uint32_t l = 0; l < levels; l++) {
+        VkImageViewCreateInfo viewCreateInfo{};
+        viewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewCreateInfo.image = hiz.im.im;
+        viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewCreateInfo.format = VK_FORMAT_R32_SFLOAT;
+        viewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        viewCreateInfo.subresourceRange.baseMipLevel = l;
+        viewCreateInfo.subresourceRange.levelCount = 1;
+        viewCreateInfo.subresourceRange.layerCount = 1;
+
+        if (vkCreateImageView(dev, &viewCreateInfo, nullptr, &hiz.views[l]) != VK_SUCCESS) {
+            throw std::runtime_error("cannot create depth pyramid view!");
+        }
+    }
+
+    std::array<VkDescriptorPoolSize, 2> sizes;
+    sizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    sizes[0].descriptorCount = levels;
+    sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    sizes[1].descriptorCount = 2 * levels;
+
+    VkDescriptorPoolCreateInfo poolCreateInfo{};
+    poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolCreateInfo.maxSets = levels;
+    poolCreateInfo.poolSizeCount = sizes.size();
+    poolCreateInfo.pPoolSizes = sizes.data();
+
+    if (vkCreateDescriptorPool(dev, &poolCreateInfo, nullptr, &hiz.pool) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create depth pyramid descriptor pool!");
+    }
+
+    std::vector<VkDescriptorSetLayout> layouts(levels, hiz.layout);
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = hiz.pool;
+    allocInfo.descriptorSetCount = levels;
+    allocInfo.pSetLayouts = layouts.data();
+
+    hiz.sets.resize(levels);
+    if (vkAllocateDescriptorSets(dev, &allocInfo, hiz.sets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create depth pyramid descriptor sets!");
+    }
+
+    for (uint32_t l = 0; l < levels; l++) {
+        // level 0 never reads src, but it still has to be bound to something
+        std::array<VkDescriptorImageInfo, 3> imageInfos = {};
+        imageInfos[0] = {hiz.samp, depth.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+        imageInfos[1] = {VK_NULL_HANDLE, hiz.views[l > 0 ? l - 1 : 0], VK_IMAGE_LAYOUT_GENERAL};
+        imageInfos[2] = {VK_NULL_HANDLE, hiz.views[l], VK_IMAGE_LAYOUT_GENERAL};
+
+        std::array<VkWriteDescriptorSet, 3> sets = {};
+        for (size_t i = 0; i < sets.size(); i++) {
+            sets[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            sets[i].dstSet = hiz.sets[l];
+            sets[i].dstBinding = i;
+            sets[i].dstArrayElement = 0;
+            sets[i].descriptorCount = 1;
+            sets[i].descriptorType = (i == 0) ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            sets[i].pImageInfo = &imageInfos[i];
+        }
+
+        vkUpdateDescriptorSets(dev, sets.size(), sets.data(), 0, nullptr);
+    }
+
+    hiz.generation++; // recordCull points each frame's cull set at it when that frame comes around
+}
+
+void appvk::destroyDepthPyramid() {
+    retire([this, pool = hiz.pool, views = hiz.views, im = hiz.im]() mutable {
+        vkDestroyDescriptorPool(dev, pool, nullptr);
+
+        for (VkImageView v : views) {
+            vkDestroyImageView(dev, v, nullptr);
+        }
+
+        vkDestroyImageView(dev, im.view, nullptr);
+        vkDestroyImage(dev, im.im, nullptr);
+        allocator.free(im.mem);
+    });
+
+    hiz.pool = VK_NULL_HANDLE;
+    hiz.sets.clear();
+    hiz.views.clear();
+    hiz.im = image{};
+}
+
+// between earlyPass and the late cull phase
+void appvk::recordPyramid(VkCommandBuffer cbuf) {
+    // every level is rewritten, and the last frame's late cull has to be done reading it
+    VkImageMemoryBarrier toGeneral{};
+    toGeneral.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    toGeneral.srcAccessMask = 0;
+    toGeneral.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    toGeneral.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    toGeneral.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    toGeneral.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toGeneral.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toGeneral.image = hiz.im.im;
+    toGeneral.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, hiz.im.mipLevels, 0, 1};
+
+    vkCmdPipelineBarrier(cbuf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0, 0, nullptr, 0, nullptr, 1, &toGeneral);
+
+    vkCmdBindPipeline(cbuf, VK_PIPELINE_BIND_POINT_COMPUTE, hiz.pipe);
+
+    uint32_t srcWidth = hiz.width;
+    uint32_t srcHeight = hiz.height;
+
+    for (uint32_t l = 0; l < hiz.im.mipLevels; l++) {
+        uint32_t dstWidth = (l == 0) ? hiz.width : std::max(srcWidth / 2, 1u);
+        uint32_t dstHeight = (l == 0) ? hiz.height : std::max(srcHeight / 2, 1u);
+
+        pyramidConstants pc{};
+        pc.srcSize[0] = srcWidth;
+        pc.srcSize[1] = srcHeight;
+        pc.dstSize[0] = dstWidth;
+        pc.dstSize[1] = dstHeight;
+        pc.samples = msaaSamples;
+        pc.first = (l == 0);
+
+        vkCmdBindDescriptorSets(cbuf, VK_PIPELINE_BIND_POINT_COMPUTE, hiz.pipeLayout, 0, 1, &hiz.sets[l], 0, nullptr);
+        vkCmdPushConstants(cbuf, hiz.pipeLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pc), &pc);
+        vkCmdDispatch(cbuf, (dstWidth + 7) / 8, (dstHeight + 7) / 8, 1);
+
+        // the next level, or the late cull phase after the last one, reads what this one wrote
+        VkMemoryBarrier written{};
+        written.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        written.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        written.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(cbuf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &written, 0, nullptr, 0, nullptr);
+
+        srcWidth = dstWidth;
+        srcHeight = dstHeight;
+    }
+}
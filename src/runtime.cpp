@@ -1,4 +1,5 @@
 #include <chrono>
+#include <algorithm>
 #include <cmath>
 #include <iomanip>
 
@@ -10,47 +11,47 @@
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_vulkan.h"
 
-void appvk::createSyncs() {
-    imageAvailSems.resize(options::framesInFlight, VK_NULL_HANDLE);
-    renderDoneSems.resize(options::framesInFlight, VK_NULL_HANDLE);
-    inFlightFences.resize(options::framesInFlight, VK_NULL_HANDLE);
-    imagesInFlight = std::vector<VkFence>(swapImages.size(), VK_NULL_HANDLE); // this needs to be re-created on a window resize
-    
-    VkSemaphoreCreateInfo createInfo{};
-    createInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-    
-    VkFenceCreateInfo fCreateInfo{};
-    fCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
-    for (unsigned int i = 0; i < options::framesInFlight; i++) {
-        VkResult r1 = vkCreateSemaphore(dev, &createInfo, nullptr, &imageAvailSems[i]);
-        VkResult r2 = vkCreateSemaphore(dev, &createInfo, nullptr, &renderDoneSems[i]);
-        VkResult r3 = vkCreateFence(dev, &fCreateInfo, nullptr, &inFlightFences[i]);
-        
-        if (r1 != VK_SUCCESS || r2 != VK_SUCCESS || r3 != VK_SUCCESS) {
-            throw std::runtime_error("cannot create sync objects!");
-        }
-    }
-}
+void appvk::updateFrame() {
+    // the last frame to use currFrame's region of the ring is done, so it's free to overwrite
+    beginUniformFrame(currFrame);
+
+    glm::mat4 view = glm::lookAt(c.pos, c.pos + c.front, glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 proj = glm::perspective(glm::radians(25.0f), swapExtent.width / float(swapExtent.height), 0.1f, 100.0f);
+
+    // for cull.comp. proj[1][1] is cot(fov / 2)
+    viewProj = proj * view;
+    pixelsPerUnit = proj[1][1] * swapExtent.height * 0.5f;
+    readCullStats(currFrame);
+    readProfilerFrame(currFrame);
+
+    // eviction decides on these numbers too, so they're refreshed whether or not the overlay is open
+    allocator.updateBudget();
 
-void appvk::updateFrame(uint32_t imageIndex) {
-    ubo u;
-    // u.model = glm::mat4(1.0f);
-    u.model = glm::rotate(glm::mat4(1.0f), glm::radians((float)glfwGetTime() * 20), glm::vec3(1.0f));
-    u.view = glm::lookAt(c.pos, c.pos + c.front, glm::vec3(0.0f, 1.0f, 0.0f));
-    u.proj = glm::perspective(glm::radians(25.0f), swapExtent.width / float(swapExtent.height), 0.1f, 100.0f);
+    // positions come in as snorm16 in the mesh's bounding box
+    auto dequantise = [this](ubo* u, const thing& t) {
+        const pvert::bounds& b = meshes.meshes[t.meshId].box;
+        for (int i = 0; i < 3; i++) {
+            u->posScale[i] = (b.max[i] - b.min[i]) * 0.5f;
+            u->posOffset[i] = (b.max[i] + b.min[i]) * 0.5f;
+        }
+    };
 
-    void* data;
-    vkMapMemory(dev, t.ubos.mem, imageIndex * t.ubos.elemSize, sizeof(ubo), 0, &data);
-    memcpy(data, &u, sizeof(ubo));
-    vkUnmapMemory(dev, t.ubos.mem);
+    // only the spinning object changes, the rest of the instances are left alone
+    setInstance(t.firstInstance, glm::rotate(glm::mat4(1.0f), glm::radians((float)glfwGetTime() * 20), glm::vec3(1.0f)));
+    flushInstances(currFrame);
 
-    u.model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -1.0f, 0.0f));
+    // uniform memory stays mapped, so these are plain stores
+    ubo* u = static_cast<ubo*>(allocUniform(sizeof(ubo), t.uboOffset));
+    u->view = view;
+    u->proj = proj;
+    u->eye = glm::vec4(c.pos, 1.0f);
+    dequantise(u, t);
 
-    vkMapMemory(dev, flr.ubos.mem, imageIndex * t.ubos.elemSize, sizeof(ubo), 0, &data);
-    memcpy(data, &u, sizeof(ubo));
-    vkUnmapMemory(dev, flr.ubos.mem);
+    u = static_cast<ubo*>(allocUniform(sizeof(ubo), flr.uboOffset));
+    u->view = view;
+    u->proj = proj;
+    u->eye = glm::vec4(c.pos, 1.0f);
+    dequantise(u, flr);
 
     ImGui_ImplVulkan_NewFrame();
 	ImGui_ImplGlfw_NewFrame();
@@ -64,10 +65,103 @@ void appvk::updateFrame(uint32_t imageIndex) {
     	float time = duration<float, seconds::period>(current - last).count();
     	last = current;
 
-		ImGui::Text("screen dimensions: %dx%d", options::screenWidth, options::screenHeight);
+		ImGui::Text("screen dimensions: %ux%u", swapExtent.width, swapExtent.height);
 		ImGui::Text("msaa samples: %d", options::msaaSamples);
 		ImGui::Text("frame time: %.2f ms (%.2f fps)", time * 1000, 1.0f / time);
 		ImGui::Text("camera pos: (%.2f, %.2f, %.2f)", c.pos.x, c.pos.y, c.pos.z);
+		ImGui::Text("triangles: %u", cull.triangles);
+		ImGui::Text("instances: %u / %zu visible in %zu indirect draws%s", cull.visible, instances.data.size(), 2 * things.size(),
+			drawIndirectCount ? "" : " (no draw count)");
+		ImGui::Text("occluded: %u instances", cull.occluded);
+		ImGui::Text("depth pyramid: %ux%u, %u levels", hiz.width, hiz.height, hiz.im.mipLevels);
+
+		ImGui::Text("recording: %.3f ms on the main thread, scene recorded %u times", recordMs, sceneRecords);
+		for (size_t i = 0; i < options::recordThreads; i++) {
+			const recorder& r = recorders[currFrame * options::recordThreads + i];
+			if (r.begin != r.end) {
+				ImGui::Text("  worker %zu: %.3f ms for %zu things (last time it ran)", i, r.ms, r.end - r.begin);
+			}
+		}
+
+		vmem::stats memStats = allocator.getStats();
+		ImGui::Text("device memory: %.1f / %.1f MiB in %zu blocks, %zu allocations",
+			memStats.used / 1048576.0f, memStats.reserved / 1048576.0f, memStats.blocks, memStats.allocations);
+		ImGui::Text("fragmentation: %.1f%% (largest free range %.1f MiB)", memStats.fragmentation * 100.0f, memStats.largestFree / 1048576.0f);
+		ImGui::Text("staging: %.1f MiB reserved, %.1f MiB high water",
+			staging.reserved / 1048576.0f, staging.highWater / 1048576.0f);
+		ImGui::Text("mesh pool: %.1f / %.1f MiB vertices, %.1f / %.1f MiB indices",
+			meshes.vertRange->used() / 1048576.0f, meshes.vertRange->size() / 1048576.0f,
+			meshes.indexRange->used() / 1048576.0f, meshes.indexRange->size() / 1048576.0f);
+
+		if (ImGui::CollapsingHeader("gpu time", ImGuiTreeNodeFlags_DefaultOpen)) {
+			if (prof.frames.empty()) {
+				ImGui::Text("the graphics queue can't write timestamps");
+			}
+
+			// min / avg / max over the last options::profilerHistory results, which are a few frames behind
+			for (const scopeHistory& h : prof.scopes) {
+				auto [lo, hi] = std::minmax_element(h.ms.begin(), h.ms.end());
+				float sum = 0.0f;
+				for (float ms : h.ms) {
+					sum += ms;
+				}
+
+				ImGui::Text("%*s%s: %.3f / %.3f / %.3f ms", int(h.depth * 2), "", h.name, *lo, sum / h.ms.size(), *hi);
+			}
+		}
+
+		if (ImGui::CollapsingHeader("frame pacing", ImGuiTreeNodeFlags_DefaultOpen)) {
+			// only what the surface supports is offered, applied at the start of the next frame
+			std::vector<const char*> names;
+			int selected = 0;
+			for (size_t i = 0; i < presentModes.size(); i++) {
+				names.push_back(presentModeName(presentModes[i]));
+				if (presentModes[i] == wantedPresentMode) {
+					selected = int(i);
+				}
+			}
+
+			if (ImGui::Combo("present mode", &selected, names.data(), int(names.size()))) {
+				wantedPresentMode = presentModes[selected];
+			}
+
+			int frames = int(wantedFramesInFlight);
+			if (ImGui::SliderInt("frames in flight", &frames, 1, int(options::maxFramesInFlight))) {
+				wantedFramesInFlight = uint32_t(frames);
+			}
+
+			// latency is from the cpu starting a frame to the gpu finishing it, presentation isn't included
+			std::lock_guard<std::mutex> lock(pacingLock);
+			for (size_t i = 0; i < pacing.size(); i++) {
+				const pacingStats& s = pacing[i];
+				double latency = s.frames ? s.latencySum / s.frames : 0.0;
+				double interval = s.intervals ? s.intervalSum / s.intervals : 0.0;
+
+				ImGui::Text("%s %s x%u: latency %.2f ms (max %.2f), %.1f fps over %llu frames", (i == pacingConfig) ? ">" : " ",
+					presentModeName(s.mode), s.framesInFlight, latency, s.latencyMax,
+					interval > 0.0 ? 1000.0 / interval : 0.0, (unsigned long long)s.frames);
+			}
+		}
+
+		if (ImGui::CollapsingHeader("memory budget", ImGuiTreeNodeFlags_DefaultOpen)) {
+			if (!memoryBudget) {
+				ImGui::Text("VK_EXT_memory_budget not available, budget is 80%% of each heap");
+			}
+
+			std::vector<vmem::heapStats> heaps = allocator.getHeapStats();
+			for (size_t i = 0; i < heaps.size(); i++) {
+				const vmem::heapStats& h = heaps[i];
+				float fill = (h.budget > 0) ? float(h.usage) / float(h.budget) : 0.0f;
+
+				ImGui::Text("heap %zu%s: %.1f / %.1f MiB (ours %.1f MiB, heap %.1f MiB)", i, h.deviceLocal ? " (device local)" : "",
+					h.usage / 1048576.0f, h.budget / 1048576.0f, h.reserved / 1048576.0f, h.size / 1048576.0f);
+				ImGui::ProgressBar(fill);
+			}
+
+			for (size_t c = 0; c < vmem::categoryCount; c++) {
+				ImGui::Text("%s: %.1f MiB", vmem::categoryName(vmem::category(c)), memStats.categories[c] / 1048576.0f);
+			}
+		}
 	}
 
 	ImGui::End(); // must be called regardless of begin() return value
@@ -0,0 +1,293 @@
+#include "mopt.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+#include <cmath>
+#include <cstring>
+
+#include "glm_mat_wrapper.hpp"
+
+namespace mopt {
+
+    static constexpr uint32_t none = UINT32_MAX;
+
+    static glm::vec3 position(const vformat::vertex& v) {
+        float p[3];
+        memcpy(p, &v, sizeof(p));
+        return glm::vec3(p[0], p[1], p[2]);
+    }
+
+    // Garland and Heckbert, "Surface Simplification Using Quadric Error Metrics", 1997.
+    // symmetric 4x4 matrix summing squared distances to a set of planes, weighted by triangle area
+    struct quadric {
+        double xx = 0, xy = 0, xz = 0, xw = 0;
+        double yy = 0, yz = 0, yw = 0;
+        double zz = 0, zw = 0;
+        double ww = 0;
+        double weight = 0;
+
+        void addPlane(const glm::vec3& n, double d, double w) {
+            xx += w * n.x * n.x; xy += w * n.x * n.y; xz += w * n.x * n.z; xw += w * n.x * d;
+            yy += w * n.y * n.y; yz += w * n.y * n.z; yw += w * n.y * d;
+            zz += w * n.z * n.z; zw += w * n.z * d;
+            ww += w * d * d;
+            weight += w;
+        }
+
+        void add(const quadric& q) {
+            xx += q.xx; xy += q.xy; xz += q.xz; xw += q.xw;
+            yy += q.yy; yz += q.yz; yw += q.yw;
+            zz += q.zz; zw += q.zw;
+            ww += q.ww;
+            weight += q.weight;
+        }
+
+        // mean squared distance from p to the planes
+        double error(const glm::vec3& p) const {
+            double e = xx * p.x * p.x + 2 * xy * p.x * p.y + 2 * xz * p.x * p.z + 2 * xw * p.x
+                + yy * p.y * p.y + 2 * yz * p.y * p.z + 2 * yw * p.y
+                + zz * p.z * p.z + 2 * zw * p.z
+                + ww;
+
+            return weight > 0 ? std::fabs(e) / weight : 0;
+        }
+    };
+
+    // collapses edges onto their existing endpoints, so the vertex buffer is shared with the input and only
+    // indices change. vertices on borders and attribute seams never move, which keeps uvs and hard edges intact.
+    std::vector<uint32_t> simplify(const std::vector<vformat::vertex>& verts, const std::vector<uint32_t>& indices,
+        size_t targetIndexCount, float& error) {
+
+        size_t vertexCount = verts.size();
+        error = 0.0f;
+
+        // vertices that only differ in normal or uv are one position to the simplifier
+        struct key {
+            uint32_t bits[3];
+            bool operator==(const key& k) const { return memcmp(bits, k.bits, sizeof(bits)) == 0; }
+        };
+
+        struct keyHash {
+            size_t operator()(const key& k) const { return (k.bits[0] * 73856093u) ^ (k.bits[1] * 19349663u) ^ (k.bits[2] * 83492791u); }
+        };
+
+        std::unordered_map<key, uint32_t, keyHash> posIds;
+        std::vector<uint32_t> pos(vertexCount);
+        std::vector<uint32_t> wedges;
+
+        for (size_t i = 0; i < vertexCount; i++) {
+            key k;
+            memcpy(k.bits, &verts[i], sizeof(k.bits));
+
+            auto it = posIds.try_emplace(k, uint32_t(wedges.size())).first;
+            if (it->second == wedges.size()) {
+                wedges.push_back(0);
+            }
+
+            pos[i] = it->second;
+            wedges[pos[i]]++;
+        }
+
+        size_t posCount = wedges.size();
+        std::vector<glm::vec3> points(posCount);
+        for (size_t i = 0; i < vertexCount; i++) {
+            points[pos[i]] = position(verts[i]);
+        }
+
+        std::vector<quadric> quadrics(posCount);
+        std::unordered_map<uint64_t, uint32_t> edgeUses;
+
+        for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+            uint32_t p[3] = {pos[indices[t]], pos[indices[t + 1]], pos[indices[t + 2]]};
+
+            glm::vec3 n = glm::cross(points[p[1]] - points[p[0]], points[p[2]] - points[p[0]]);
+            float area = glm::length(n);
+            if (area > 0) {
+                n /= area;
+                float d = -glm::dot(n, points[p[0]]);
+                for (uint32_t v : p) {
+                    quadrics[v].addPlane(n, d, area);
+                }
+            }
+
+            for (int k = 0; k < 3; k++) {
+                uint32_t a = std::min(p[k], p[(k + 1) % 3]);
+                uint32_t b = std::max(p[k], p[(k + 1) % 3]);
+                edgeUses[(uint64_t(a) << 32) | b]++;
+            }
+        }
+
+        std::vector<bool> locked(posCount, false);
+        for (size_t p = 0; p < posCount; p++) {
+            locked[p] = wedges[p] > 1;
+        }
+
+        for (const auto& [e, uses] : edgeUses) {
+            if (uses == 1) {
+                locked[e >> 32] = true;
+                locked[e & 0xffffffff] = true;
+            }
+        }
+
+        struct collapse {
+            uint32_t from;
+            uint32_t to;
+            double cost;
+        };
+
+        std::vector<uint32_t> out = indices;
+        std::vector<collapse> candidates;
+        std::vector<uint32_t> adjOffset(posCount + 1);
+        std::vector<uint32_t> adj;
+        std::vector<uint32_t> collapseTo(vertexCount);
+        std::vector<bool> touched(posCount);
+        double maxCost = 0;
+
+        // each pass collapses as many independent edges as it can, cheapest first
+        while (out.size() > targetIndexCount) {
+            candidates.clear();
+            for (size_t t = 0; t < out.size(); t += 3) {
+                for (int k = 0; k < 3; k++) {
+                    uint32_t a = out[t + k];
+                    uint32_t b = out[t + (k + 1) % 3];
+
+                    for (int dir = 0; dir < 2; dir++) {
+                        if (!locked[pos[a]]) {
+                            quadric q = quadrics[pos[a]];
+                            q.add(quadrics[pos[b]]);
+                            candidates.push_back({a, b, q.error(points[pos[b]])});
+                        }
+
+                        std::swap(a, b);
+                    }
+                }
+            }
+
+            std::sort(candidates.begin(), candidates.end(), [](const collapse& a, const collapse& b) { return a.cost < b.cost; });
+
+            // triangles around each position
+            std::fill(adjOffset.begin(), adjOffset.end(), 0);
+            for (uint32_t i : out) {
+                adjOffset[pos[i] + 1]++;
+            }
+
+            for (size_t p = 0; p < posCount; p++) {
+                adjOffset[p + 1] += adjOffset[p];
+            }
+
+            adj.resize(out.size());
+            std::vector<uint32_t> fill(adjOffset.begin(), adjOffset.end() - 1);
+            for (size_t i = 0; i < out.size(); i++) {
+                adj[fill[pos[out[i]]]++] = i / 3;
+            }
+
+            std::fill(collapseTo.begin(), collapseTo.end(), none);
+            std::fill(touched.begin(), touched.end(), false);
+
+            size_t removeBudget = out.size() - targetIndexCount;
+            size_t removed = 0;
+            bool any = false;
+
+            for (const collapse& c : candidates) {
+                uint32_t pu = pos[c.from];
+                uint32_t pv = pos[c.to];
+                if (pu == pv || touched[pu] || touched[pv] || removed >= removeBudget) {
+                    continue;
+                }
+
+                // moving u onto v mustn't turn any remaining triangle around u inside out
+                bool flips = false;
+                size_t dying = 0;
+                for (uint32_t a = adjOffset[pu]; a < adjOffset[pu + 1] && !flips; a++) {
+                    uint32_t t = adj[a];
+                    uint32_t p[3] = {pos[out[t * 3]], pos[out[t * 3 + 1]], pos[out[t * 3 + 2]]};
+
+                    if (p[0] == pv || p[1] == pv || p[2] == pv) {
+                        dying++;
+                        continue;
+                    }
+
+                    glm::vec3 before = glm::cross(points[p[1]] - points[p[0]], points[p[2]] - points[p[0]]);
+                    for (uint32_t& q : p) {
+                        if (q == pu) {
+                            q = pv;
+                        }
+                    }
+
+                    glm::vec3 after = glm::cross(points[p[1]] - points[p[0]], points[p[2]] - points[p[0]]);
+                    flips = glm::dot(before, after) <= 0;
+                }
+
+                if (flips) {
+                    continue;
+                }
+
+                collapseTo[c.from] = c.to;
+                maxCost = std::max(maxCost, c.cost);
+                removed += dying * 3;
+                any = true;
+
+                // everything around u is changing, so don't let another collapse this pass reason about it
+                for (uint32_t a = adjOffset[pu]; a < adjOffset[pu + 1]; a++) {
+                    uint32_t t = adj[a];
+                    for (int k = 0; k < 3; k++) {
+                        touched[pos[out[t * 3 + k]]] = true;
+                    }
+                }
+            }
+
+            if (!any) {
+                break;
+            }
+
+            // u has a single wedge, so redirecting that one index moves every triangle using the position
+            for (uint32_t& i : out) {
+                if (collapseTo[i] != none) {
+                    quadrics[pos[collapseTo[i]]].add(quadrics[pos[i]]);
+                    quadrics[pos[i]] = quadric{}; // only merge once, later indices see an empty quadric
+                    i = collapseTo[i];
+                }
+            }
+
+            size_t kept = 0;
+            for (size_t t = 0; t < out.size(); t += 3) {
+                uint32_t a = pos[out[t]], b = pos[out[t + 1]], c = pos[out[t + 2]];
+                if (a != b && b != c && a != c) {
+                    std::copy(out.begin() + t, out.begin() + t + 3, out.begin() + kept);
+                    kept += 3;
+                }
+            }
+
+            out.resize(kept);
+        }
+
+        error = float(std::sqrt(maxCost));
+        return out;
+    }
+
+    std::vector<level> buildLods(const std::vector<vformat::vertex>& verts, const std::vector<uint32_t>& indices, size_t maxLevels) {
+        std::vector<level> levels = {{indices, 0.0f}};
+
+        while (levels.size() < maxLevels) {
+            size_t target = levels.back().indices.size() / 6 * 3; // half the triangles of the previous level
+            if (target < minLodTriangles * 3) {
+                break;
+            }
+
+            // always from the full mesh, so the error is against the original surface
+            level next;
+            next.indices = simplify(verts, indices, target, next.error);
+
+            // stop once locked vertices keep the simplifier from getting anywhere
+            if (next.indices.size() > levels.back().indices.size() * 9 / 10) {
+                break;
+            }
+
+            next.error = std::max(next.error, levels.back().error);
+            optimizeVertexCache(next.indices, verts.size());
+            levels.push_back(std::move(next));
+        }
+
+        return levels;
+    }
+}
@@ -4,6 +4,9 @@
 
 #include <cstdint> // for UINT32_MAX
 
+#include "imgui.h"
+#include "imgui_impl_vulkan.h"
+
 void appvk::createSurface() {
     // platform-agnostic version of vulkan create surface extension
     if (glfwCreateWindowSurface(instance, w, nullptr, &surf) != VK_SUCCESS) {
@@ -45,13 +48,38 @@ VkSurfaceFormatKHR appvk::chooseSwapSurfaceFormat(const std::vector<VkSurfaceFor
     return formatList[0];
 }
 
+const char* presentModeName(VkPresentModeKHR mode) {
+    switch (mode) {
+    case VK_PRESENT_MODE_FIFO_KHR: return "fifo";
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "fifo_relaxed";
+    case VK_PRESENT_MODE_MAILBOX_KHR: return "mailbox";
+    case VK_PRESENT_MODE_IMMEDIATE_KHR: return "immediate";
+    default: return "other";
+    }
+}
+
+std::optional<VkPresentModeKHR> parsePresentMode(std::string_view name) {
+    for (VkPresentModeKHR mode : {VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR}) {
+        if (name == presentModeName(mode)) {
+            return mode;
+        }
+    }
+
+    return std::nullopt;
+}
+
 VkPresentModeKHR appvk::chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& modeList) {
     for (const auto& mode : modeList) {
-        if (mode == VK_PRESENT_MODE_MAILBOX_KHR) { // triple buffer if possible
+        if (mode == wantedPresentMode) {
             return mode;
         }
     }
 
+    // the only mode every surface has to support. only mentioned when it was just asked for, not on every resize
+    if (wantedPresentMode != VK_PRESENT_MODE_FIFO_KHR && wantedPresentMode != requestedPresentMode) {
+        cout << presentModeName(wantedPresentMode) << " isn't supported by the surface, using fifo\n";
+    }
+
     return VK_PRESENT_MODE_FIFO_KHR;
 }
 
@@ -78,7 +106,9 @@ void appvk::createSwapChain() {
     VkExtent2D e = chooseSwapExtent(sdet.cap);
     
     uint32_t numImages = sdet.cap.minImageCount + 1; // perf improvement - don't have to wait for the driver to complete stuff to continue rendering
-    numImages = std::min(numImages, sdet.cap.maxImageCount);
+    if (sdet.cap.maxImageCount > 0) { // 0 means no limit
+        numImages = std::min(numImages, sdet.cap.maxImageCount);
+    }
 
     VkSwapchainCreateInfoKHR sInfo{};
     sInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
@@ -96,11 +126,20 @@ void appvk::createSwapChain() {
     sInfo.preTransform = sdet.cap.currentTransform;
     sInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
     sInfo.clipped = VK_TRUE;
-    sInfo.oldSwapchain = VK_NULL_HANDLE;
+    sInfo.oldSwapchain = swap; // null the first time. lets the driver hand resources over, and frames in flight can still present to it
 
-    if (vkCreateSwapchainKHR(dev, &sInfo, nullptr, &swap) != VK_SUCCESS) {
+    VkSwapchainKHR newSwap;
+    if (vkCreateSwapchainKHR(dev, &sInfo, nullptr, &newSwap) != VK_SUCCESS) {
         throw std::runtime_error("unable to create swapchain!");
     }
+
+    // without VK_EXT_swapchain_maintenance1 there's no telling when a present is done, but each one is queued right
+    // after its frame, so by the time the frames in flight have finished it has been taken
+    if (swap != VK_NULL_HANDLE) {
+        retire([this, old = swap] { vkDestroySwapchainKHR(dev, old, nullptr); });
+    }
+
+    swap = newSwap;
     
     uint32_t imageCount;
     vkGetSwapchainImagesKHR(dev, swap, &imageCount, nullptr);
@@ -109,6 +148,9 @@ void appvk::createSwapChain() {
     
     swapFormat = f.format;
     swapExtent = e;
+    presentMode = p;
+    requestedPresentMode = wantedPresentMode;
+    presentModes = sdet.presentModes;
 }
 
 void appvk::createSwapViews() {
@@ -118,48 +160,38 @@ void appvk::createSwapViews() {
     }
 }
 
+// retires what depends on the swapchain's size or images, see recreateSwapChain. the swapchain itself is left for
+// createSwapChain to pass on as oldSwapchain.
 void appvk::cleanupSwapChain() {
+    destroyDepthPyramid();
+    destroyTransientAttachments(); // their memory is kept for the next swapchain
 
-    for (unsigned int i = 0; i < options::framesInFlight; i++){
-        vkDestroySemaphore(dev, imageAvailSems[i], nullptr);
-        vkDestroySemaphore(dev, renderDoneSems[i], nullptr);
-        vkDestroyFence(dev, inFlightFences[i], nullptr);
-    }
-
-    vkFreeCommandBuffers(dev, cp, commandBuffers.size(), commandBuffers.data());
-
-    vkDestroyImageView(dev, depth.view, nullptr);
-    vkDestroyImage(dev, depth.im, nullptr);
-    vkFreeMemory(dev, depth.mem, nullptr);
+    retire([this, framebuffers = swapFramebuffers, early = earlyFramebuffer, views = swapImageViews] {
+        for (auto framebuffer : framebuffers) {
+            vkDestroyFramebuffer(dev, framebuffer, nullptr);
+        }
 
-    vkDestroyImageView(dev, ms.view, nullptr);
-    vkDestroyImage(dev, ms.im, nullptr);
-    vkFreeMemory(dev, ms.mem, nullptr);
+        vkDestroyFramebuffer(dev, early, nullptr);
 
-    for (thing& t : things) {
-        for (VkBuffer buf : t.ubos.bufs) {
-            vkDestroyBuffer(dev, buf, nullptr);
+        for (const auto& view : views) {
+            vkDestroyImageView(dev, view, nullptr);
         }
+    });
 
-        vkFreeMemory(dev, t.ubos.mem, nullptr);
-        t.ubos.mem = VK_NULL_HANDLE;
+    swapFramebuffers.clear();
+    swapImageViews.clear();
+    earlyFramebuffer = VK_NULL_HANDLE;
+}
 
+// the render passes only depend on formats, but the graphics pipelines and the ui backend are built against them
+void appvk::cleanupRenderPass() {
+    for (thing& t : things) {
         vkDestroyPipeline(dev, t.pipe, nullptr);
-        vkDestroyPipelineLayout(dev, t.pipeLayout, nullptr);
     }
 
-    vkDestroyDescriptorPool(dev, dPool, nullptr);
+    ImGui_ImplVulkan_Shutdown();
     vkDestroyDescriptorPool(dev, uiPool, nullptr);
 
-    for (auto framebuffer : swapFramebuffers) {
-        vkDestroyFramebuffer(dev, framebuffer, nullptr);
-    }
-
     vkDestroyRenderPass(dev, renderPass, nullptr);
-    
-    for (const auto& view : swapImageViews) {
-        vkDestroyImageView(dev, view, nullptr);
-    }
-
-    vkDestroySwapchainKHR(dev, swap, nullptr);
-}
\ No newline at end of file
+    vkDestroyRenderPass(dev, earlyPass, nullptr);
+}
@@ -0,0 +1,137 @@
+#include "main.hpp"
+
+#include <algorithm>
+
+void appvk::createTransientAttachments(const std::vector<transientAttachment>& attachments) {
+    std::vector<VkMemoryRequirements> reqs(attachments.size());
+
+    for (size_t i = 0; i < attachments.size(); i++) {
+        const transientAttachment& a = attachments[i];
+
+        VkImageCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        createInfo.imageType = VK_IMAGE_TYPE_2D;
+        createInfo.format = a.format;
+        createInfo.extent = {swapExtent.width, swapExtent.height, 1};
+        createInfo.mipLevels = 1;
+        createInfo.arrayLayers = 1;
+        createInfo.samples = msaaSamples;
+        createInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        createInfo.usage = a.kept ? a.usage : a.usage | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+        createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        createInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        *a.target = image{};
+        if (vkCreateImage(dev, &createInfo, nullptr, &a.target->im) != VK_SUCCESS) {
+            throw std::runtime_error("cannot create attachment image!");
+        }
+
+        a.target->mipLevels = 1;
+        vkGetImageMemoryRequirements(dev, a.target->im, &reqs[i]);
+    }
+
+    // greedy interval colouring: in order of first use, put each attachment in the first slot whose previous occupant
+    // is done by then and that can hold its memory type
+    std::vector<size_t> order(attachments.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return attachments[a].firstPass < attachments[b].firstPass;
+    });
+
+    struct slotReq {
+        VkMemoryRequirements req{};
+        uint32_t lastPass = 0;
+    };
+
+    std::vector<slotReq> slots;
+    std::vector<size_t> slotOf(attachments.size());
+
+    for (size_t i : order) {
+        size_t s = 0;
+        for (; s < slots.size(); s++) {
+            if (slots[s].lastPass < attachments[i].firstPass && (slots[s].req.memoryTypeBits & reqs[i].memoryTypeBits)) {
+                break;
+            }
+        }
+
+        if (s == slots.size()) {
+            slots.push_back({reqs[i], attachments[i].lastPass});
+        } else {
+            slots[s].req.size = std::max(slots[s].req.size, reqs[i].size);
+            slots[s].req.alignment = std::max(slots[s].req.alignment, reqs[i].alignment);
+            slots[s].req.memoryTypeBits &= reqs[i].memoryTypeBits;
+            slots[s].lastPass = attachments[i].lastPass;
+        }
+
+        slotOf[i] = s;
+    }
+
+    // keep the old memory if it's big enough, otherwise grow it
+    transientSlots.resize(std::max(transientSlots.size(), slots.size()));
+
+    for (size_t s = 0; s < slots.size(); s++) {
+        vmem::allocation& mem = transientSlots[s];
+        const VkMemoryRequirements& req = slots[s].req;
+
+        bool fits = mem.owner && mem.size >= req.size && (mem.offset % req.alignment) == 0 &&
+            (req.memoryTypeBits & (1u << mem.owner->type));
+
+        if (!fits) {
+            VkMemoryRequirements grown = req;
+            grown.size = std::max(req.size, mem.size);
+
+            // the previous attachments may still be in use by frames in flight
+            if (mem.owner) {
+                retire([this, old = mem]() mutable { allocator.free(old); });
+            }
+
+            mem = allocator.alloc(grown, {VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT,
+                vmem::usage::gpuOnly, vmem::category::attachment}, false);
+        }
+    }
+
+    transientImages.clear();
+
+    for (size_t i = 0; i < attachments.size(); i++) {
+        const transientAttachment& a = attachments[i];
+        const vmem::allocation& mem = transientSlots[slotOf[i]];
+
+        vkBindImageMemory(dev, a.target->im, mem.mem, mem.offset);
+        a.target->view = createImageView(a.target->im, a.format, 1, a.aspect);
+
+        transientImages.push_back(a.target);
+    }
+}
+
+// retires the images but leaves the slots for the next createTransientAttachments. the next attachments may alias
+// memory that frames in flight are still rendering to, which is fine since it's all on one queue and every pass
+// orders itself after the previous frame's attachment writes.
+void appvk::destroyTransientAttachments() {
+    std::vector<image> old;
+    for (image* im : transientImages) {
+        old.push_back(*im);
+
+        im->view = VK_NULL_HANDLE;
+        im->im = VK_NULL_HANDLE;
+    }
+
+    retire([this, old] {
+        for (const image& im : old) {
+            vkDestroyImageView(dev, im.view, nullptr);
+            vkDestroyImage(dev, im.im, nullptr);
+        }
+    });
+
+    transientImages.clear();
+}
+
+void appvk::freeTransientSlots() {
+    for (vmem::allocation& mem : transientSlots) {
+        allocator.free(mem);
+    }
+
+    transientSlots.clear();
+}
@@ -50,11 +50,11 @@ void appvk::initVulkanUI() {
     initInfo.Device = dev;
     initInfo.QueueFamily = gQueueFamily;
     initInfo.Queue = gQueue;
-    initInfo.PipelineCache = VK_NULL_HANDLE;
+    initInfo.PipelineCache = pipeCache;
     initInfo.DescriptorPool = uiPool;
     initInfo.Allocator = nullptr;
     initInfo.MinImageCount = 2;
-    initInfo.ImageCount = options::framesInFlight;
+    initInfo.ImageCount = options::maxFramesInFlight; // its buffers are reused after this many frames
 	initInfo.MSAASamples = getSamples(options::msaaSamples);
     initInfo.CheckVkResultFn = imguiCheck;
     ImGui_ImplVulkan_Init(&initInfo, renderPass);
@@ -1,17 +1,43 @@
 #include "main.hpp"
 
-void appvk::createUniformBuffers() {
-    for (thing& t : things) {
-        t.ubos = createBuffers(sizeof(ubo), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, 
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, swapImages.size());
+#include "options.hpp"
+
+void appvk::createUniformRing() {
+    VkPhysicalDeviceProperties dprop;
+    vkGetPhysicalDeviceProperties(pdev, &dprop);
+    uniforms.align = dprop.limits.minUniformBufferOffsetAlignment;
+
+    // round up so every region starts on an aligned offset too
+    uniforms.regionSize = (options::uniformRegionSize + uniforms.align - 1) / uniforms.align * uniforms.align;
+
+    uniforms.buf = createBuffer(uniforms.regionSize * options::maxFramesInFlight, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, vmem::usage::dynamic, vmem::category::uniform);
+}
+
+// start handing out uniform space from the region owned by frame
+void appvk::beginUniformFrame(uint32_t frame) {
+    uniforms.regionStart = frame * uniforms.regionSize;
+    uniforms.head = 0;
+}
+
+// returns size bytes of mapped uniform memory to write into, and the dynamic offset to bind it with
+void* appvk::allocUniform(VkDeviceSize size, uint32_t& offset) {
+    VkDeviceSize start = (uniforms.head + uniforms.align - 1) / uniforms.align * uniforms.align;
+    if (start + size > uniforms.regionSize) {
+        throw std::runtime_error("uniform ring region is full!");
     }
+
+    uniforms.head = start + size;
+    offset = uniforms.regionStart + start;
+
+    return static_cast<char*>(uniforms.buf.mem.mapped) + offset;
 }
 
 void appvk::createDescriptorSetLayout() {
-    std::array<VkDescriptorSetLayoutBinding, 2> bindings = {};
+    std::array<VkDescriptorSetLayoutBinding, 3> bindings = {};
 
     bindings[0].binding = 0;
-    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC; // offset into the uniform ring is given at bind time
     bindings[0].descriptorCount = 1;
     bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
@@ -21,6 +47,11 @@ void appvk::createDescriptorSetLayout() {
     bindings[1].descriptorCount = t.maps.size(); // descriptors for different kinds of maps
     bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
+    bindings[2].binding = 2;
+    bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC; // offset picks the frame's region
+    bindings[2].descriptorCount = 1;
+    bindings[2].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
     VkDescriptorSetLayoutCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
     createInfo.bindingCount = bindings.size();
@@ -36,15 +67,18 @@ void appvk::createDescriptorSetLayout() {
 }
 
 void appvk::createDescriptorPool() {
-    std::array<VkDescriptorPoolSize, 2> poolSizes;
+    std::array<VkDescriptorPoolSize, 3> poolSizes;
 
     // reserve worst-case pool memory
-    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     poolSizes[0].descriptorCount = things.size() * swapImages.size();
 
     poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     poolSizes[1].descriptorCount = things.size() * t.maps.size() * swapImages.size();
 
+    poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    poolSizes[2].descriptorCount = things.size() * swapImages.size();
+
     VkDescriptorPoolCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
     createInfo.maxSets = swapImages.size() * things.size();
@@ -74,7 +108,7 @@ void appvk::allocDescriptorSets(VkDescriptorPool pool, thing& t) {
 void appvk::allocDescriptorSetUniform(thing& t) {
     for (size_t i = 0; i < swapImages.size(); i++) {
         VkDescriptorBufferInfo bufferInfo{};
-        bufferInfo.buffer = t.ubos.bufs[i];
+        bufferInfo.buffer = uniforms.buf.buf;
         bufferInfo.offset = 0;
         bufferInfo.range = sizeof(ubo);
 
@@ -84,7 +118,7 @@ void appvk::allocDescriptorSetUniform(thing& t) {
         set.dstBinding = 0;
         set.dstArrayElement = 0;
         set.descriptorCount = 1;
-        set.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        set.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
         set.pBufferInfo = &bufferInfo;
 
         vkUpdateDescriptorSets(dev, 1, &set, 0, nullptr);
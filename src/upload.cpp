@@ -0,0 +1,329 @@
+#include "main.hpp"
+
+#include <algorithm>
+
+#include "options.hpp"
+
+void appvk::createUploadTimeline() {
+    VkSemaphoreTypeCreateInfo typeInfo{};
+    typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    typeInfo.initialValue = 0;
+
+    VkSemaphoreCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    createInfo.pNext = &typeInfo;
+
+    if (vkCreateSemaphore(dev, &createInfo, nullptr, &uploadTimeline) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create upload timeline!");
+    }
+}
+
+// async only takes effect if there is a transfer queue separate from the graphics one
+appvk::uploadBatch appvk::beginUpload(bool async) {
+    uploadBatch b;
+    b.async = async && tQueueFamily != gQueueFamily;
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    if (b.async) {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = tcp;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = 1;
+
+        if (vkAllocateCommandBuffers(dev, &allocInfo, &b.cbuf) != VK_SUCCESS) {
+            throw std::runtime_error("cannot allocate transfer command buffer!");
+        }
+
+        vkBeginCommandBuffer(b.cbuf, &beginInfo);
+
+        b.gfx = beginSingleCommand();
+    } else {
+        b.cbuf = beginSingleCommand();
+        b.gfx = b.cbuf;
+    }
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    if (vkCreateFence(dev, &fenceInfo, nullptr, &b.fence) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create upload fence!");
+    }
+
+    b.timer = beginTimer(b.cbuf, b.async ? tQueueFamily : gQueueFamily, "upload");
+
+    return b;
+}
+
+void appvk::createStagingArena() {
+    VkPhysicalDeviceProperties dprop;
+    vkGetPhysicalDeviceProperties(pdev, &dprop);
+
+    // 16 covers the texel size of every format we upload
+    staging.align = std::max<VkDeviceSize>(16, dprop.limits.optimalBufferCopyOffsetAlignment);
+
+    staging.freeChunks.push_back(growStagingArena(options::stagingChunkSize));
+}
+
+void appvk::destroyStagingArena() {
+    if constexpr (options::verbose) {
+        cout << "staging arena: " << staging.chunks.size() << " chunks, " << staging.reserved / 1048576.0f << " MiB reserved, "
+            << staging.highWater / 1048576.0f << " MiB high water\n";
+    }
+
+    for (stagingChunk& c : staging.chunks) {
+        vkDestroyBuffer(dev, c.buf.buf, nullptr);
+        allocator.free(c.buf.mem);
+    }
+
+    staging = stagingArena{};
+}
+
+// add a chunk that can hold at least size bytes and return its index
+uint32_t appvk::growStagingArena(VkDeviceSize size) {
+    stagingChunk c;
+    c.size = (size + options::stagingChunkSize - 1) / options::stagingChunkSize * options::stagingChunkSize;
+    c.buf = createBuffer(c.size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, vmem::usage::upload, vmem::category::staging);
+
+    staging.reserved += c.size;
+
+    // reuse a slot left behind by trimStagingArena
+    for (size_t i = 0; i < staging.chunks.size(); i++) {
+        if (staging.chunks[i].size == 0) {
+            staging.chunks[i] = c;
+            return i;
+        }
+    }
+
+    staging.chunks.push_back(c);
+    return staging.chunks.size() - 1;
+}
+
+// release every chunk no batch is using. chunk indices stay valid, released ones are left with a size of 0.
+bool appvk::trimStagingArena() {
+    bool trimmed = !staging.freeChunks.empty();
+
+    for (uint32_t i : staging.freeChunks) {
+        vkDestroyBuffer(dev, staging.chunks[i].buf.buf, nullptr);
+        allocator.free(staging.chunks[i].buf.mem);
+
+        staging.reserved -= staging.chunks[i].size;
+        staging.chunks[i] = stagingChunk{};
+    }
+
+    staging.freeChunks.clear();
+
+    return trimmed;
+}
+
+// copy data into the batch's current staging chunk, moving on to a free or new chunk if it doesn't fit
+appvk::stagingSlice appvk::stageUpload(uploadBatch& b, const void* data, VkDeviceSize size) {
+    auto alignedHead = [this](const stagingChunk& c) {
+        return (c.head + staging.align - 1) / staging.align * staging.align;
+    };
+
+    if (b.chunks.empty() || alignedHead(staging.chunks[b.chunks.back()]) + size > staging.chunks[b.chunks.back()].size) {
+        uint32_t next = UINT32_MAX;
+
+        for (size_t i = 0; i < staging.freeChunks.size(); i++) {
+            if (staging.chunks[staging.freeChunks[i]].size >= size) {
+                next = staging.freeChunks[i];
+                staging.freeChunks.erase(staging.freeChunks.begin() + i);
+                break;
+            }
+        }
+
+        if (next == UINT32_MAX) {
+            next = growStagingArena(size);
+        }
+
+        b.chunks.push_back(next);
+    }
+
+    stagingChunk& c = staging.chunks[b.chunks.back()];
+    VkDeviceSize start = alignedHead(c);
+
+    staging.inUse += start + size - c.head;
+    staging.highWater = std::max(staging.highWater, staging.inUse);
+    c.head = start + size;
+
+    memcpy(static_cast<char*>(c.buf.mem.mapped) + start, data, size);
+
+    return {c.buf.buf, start};
+}
+
+// move a freshly copied buffer from the transfer family to the graphics family.
+// the release half goes in cbuf and the matching acquire in gfx; without a separate transfer queue this does nothing.
+void appvk::handOverBuffer(uploadBatch& b, VkBuffer buf, VkAccessFlags dstAccess, VkPipelineStageFlags dstStage) {
+    if (!b.async) {
+        return;
+    }
+
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = tQueueFamily;
+    barrier.dstQueueFamilyIndex = gQueueFamily;
+    barrier.buffer = buf;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+
+    // release: dstAccessMask is ignored
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = 0;
+    vkCmdPipelineBarrier(b.cbuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+        0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+    // acquire: srcAccessMask is ignored, and the semaphore wait covers the transfer stage
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = dstAccess;
+    vkCmdPipelineBarrier(b.gfx, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage,
+        0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+// same as handOverBuffer, for an image left in TRANSFER_DST_OPTIMAL
+void appvk::handOverImage(uploadBatch& b, const image& im) {
+    if (!b.async) {
+        return;
+    }
+
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = tQueueFamily;
+    barrier.dstQueueFamilyIndex = gQueueFamily;
+    barrier.image = im.im;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.levelCount = im.mipLevels;
+    barrier.subresourceRange.layerCount = 1;
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = 0;
+    vkCmdPipelineBarrier(b.cbuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+        0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    // mip generation reads and writes the image next
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(b.gfx, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+void appvk::submitUpload(uploadBatch& b) {
+    endTimer(b.cbuf, b.timer);
+
+    // make the copies visible to anything submitted to this queue later, so drawing doesn't have to wait on the fence.
+    // images are already handled by the barriers that move them to SHADER_READ_ONLY_OPTIMAL.
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+    vkCmdPipelineBarrier(b.gfx, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+
+    VkSubmitInfo subInfo{};
+    subInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    subInfo.pNext = &timelineInfo;
+    subInfo.commandBufferCount = 1;
+    subInfo.signalSemaphoreCount = 1;
+    subInfo.pSignalSemaphores = &uploadTimeline;
+
+    uint64_t copied = 0;
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT; // the acquire barriers start at the transfer stage
+
+    if (b.async) {
+        vkEndCommandBuffer(b.cbuf);
+
+        copied = ++uploadValue;
+        timelineInfo.signalSemaphoreValueCount = 1;
+        timelineInfo.pSignalSemaphoreValues = &copied;
+        subInfo.pCommandBuffers = &b.cbuf;
+
+        if (vkQueueSubmit(tQueue, 1, &subInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+            throw std::runtime_error("cannot submit transfer batch!");
+        }
+
+        // the graphics half waits for the copies
+        timelineInfo.waitSemaphoreValueCount = 1;
+        timelineInfo.pWaitSemaphoreValues = &copied;
+        subInfo.waitSemaphoreCount = 1;
+        subInfo.pWaitSemaphores = &uploadTimeline;
+        subInfo.pWaitDstStageMask = &waitStage;
+    }
+
+    vkEndCommandBuffer(b.gfx);
+
+    b.value = ++uploadValue;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &b.value;
+    subInfo.pCommandBuffers = &b.gfx;
+
+    if (vkQueueSubmit(gQueue, 1, &subInfo, b.fence) != VK_SUCCESS) {
+        throw std::runtime_error("cannot submit upload batch!");
+    }
+
+    b.submitted = true;
+}
+
+bool appvk::uploadDone(uploadBatch& b) {
+    if (b.fence == VK_NULL_HANDLE) {
+        return true; // already released
+    }
+
+    if (!b.submitted || vkGetFenceStatus(dev, b.fence) != VK_SUCCESS) {
+        return false;
+    }
+
+    releaseUpload(b);
+    return true;
+}
+
+void appvk::waitUpload(uploadBatch& b) {
+    if (b.fence == VK_NULL_HANDLE) {
+        return;
+    }
+
+    if (!b.submitted) {
+        submitUpload(b);
+    }
+
+    vkWaitForFences(dev, 1, &b.fence, VK_TRUE, UINT64_MAX);
+
+    releaseUpload(b);
+}
+
+// only call once the fence has signalled
+void appvk::releaseUpload(uploadBatch& b) {
+    // hand the staging chunks back to the arena
+    for (uint32_t i : b.chunks) {
+        staging.inUse -= staging.chunks[i].head;
+        staging.chunks[i].head = 0;
+        staging.freeChunks.push_back(i);
+    }
+
+    b.chunks.clear();
+
+    readTimer(b.timer);
+
+    if (b.async) {
+        vkFreeCommandBuffers(dev, tcp, 1, &b.cbuf);
+    }
+
+    vkFreeCommandBuffers(dev, cp, 1, &b.gfx);
+    vkDestroyFence(dev, b.fence, nullptr);
+
+    b.cbuf = VK_NULL_HANDLE;
+    b.gfx = VK_NULL_HANDLE;
+    b.fence = VK_NULL_HANDLE;
+    b.submitted = false;
+}
@@ -0,0 +1,632 @@
+#include "vmem.hpp"
+
+#include "options.hpp"
+
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+
+namespace vmem {
+
+    // heaps at least this big are split into blocks of this size, smaller heaps into eighths
+    constexpr VkDeviceSize largeHeapBlockSize = 64ull << 20;
+    constexpr VkDeviceSize largeHeapSize = 1ull << 30;
+
+    static VkDeviceSize alignUp(VkDeviceSize v, VkDeviceSize align) {
+        return (v + align - 1) / align * align;
+    }
+
+    static uint32_t log2(VkDeviceSize v) {
+        return 63 - __builtin_clzll(v);
+    }
+
+    const char* categoryName(category c) {
+        switch (c) {
+            case category::texture: return "textures";
+            case category::mesh: return "meshes";
+            case category::uniform: return "uniforms";
+            case category::attachment: return "attachments";
+            case category::staging: return "staging";
+            default: return "other";
+        }
+    }
+
+    tlsf::tlsf(VkDeviceSize size) : total(size) {
+        for (auto& fl : heads) {
+            fl.fill(invalid);
+        }
+
+        uint32_t n = newNode();
+        nodes[n].offset = 0;
+        nodes[n].size = size;
+        insertFree(n);
+    }
+
+    // sizes below slCount get one list each, everything else goes in a list by its top slLog2 + 1 bits
+    void tlsf::mapping(VkDeviceSize size, uint32_t& fl, uint32_t& sl) {
+        if (size < slCount) {
+            fl = 0;
+            sl = size;
+        } else {
+            uint32_t l = log2(size);
+            fl = l - slLog2 + 1;
+            sl = (size >> (l - slLog2)) ^ slCount; // drop the leading bit
+        }
+    }
+
+    uint32_t tlsf::newNode() {
+        if (!spareNodes.empty()) {
+            uint32_t n = spareNodes.back();
+            spareNodes.pop_back();
+            nodes[n] = node{};
+            return n;
+        }
+
+        nodes.emplace_back();
+        return nodes.size() - 1;
+    }
+
+    void tlsf::insertFree(uint32_t n) {
+        uint32_t fl, sl;
+        mapping(nodes[n].size, fl, sl);
+
+        nodes[n].free = true;
+        nodes[n].prevFree = invalid;
+        nodes[n].nextFree = heads[fl][sl];
+
+        if (heads[fl][sl] != invalid) {
+            nodes[heads[fl][sl]].prevFree = n;
+        }
+        heads[fl][sl] = n;
+
+        flBitmap |= 1ull << fl;
+        slBitmap[fl] |= 1u << sl;
+    }
+
+    void tlsf::removeFree(uint32_t n) {
+        uint32_t fl, sl;
+        mapping(nodes[n].size, fl, sl);
+
+        if (nodes[n].prevFree != invalid) {
+            nodes[nodes[n].prevFree].nextFree = nodes[n].nextFree;
+        } else {
+            heads[fl][sl] = nodes[n].nextFree;
+        }
+
+        if (nodes[n].nextFree != invalid) {
+            nodes[nodes[n].nextFree].prevFree = nodes[n].prevFree;
+        }
+
+        if (heads[fl][sl] == invalid) {
+            slBitmap[fl] &= ~(1u << sl);
+            if (slBitmap[fl] == 0) {
+                flBitmap &= ~(1ull << fl);
+            }
+        }
+
+        nodes[n].free = false;
+    }
+
+    // find a free range of at least size bytes in O(1) using the bitmaps
+    uint32_t tlsf::findFree(VkDeviceSize size) {
+        // round up to the next list boundary so that anything in the list we land on is big enough
+        if (size >= slCount) {
+            size += (1ull << (log2(size) - slLog2)) - 1;
+        }
+
+        uint32_t fl, sl;
+        mapping(size, fl, sl);
+        if (fl >= flCount) {
+            return invalid;
+        }
+
+        uint32_t slMap = slBitmap[fl] & (~0u << sl);
+        if (slMap == 0) {
+            uint64_t flMap = (fl + 1 < 64) ? flBitmap & (~0ull << (fl + 1)) : 0;
+            if (flMap == 0) {
+                return invalid;
+            }
+
+            fl = __builtin_ctzll(flMap);
+            slMap = slBitmap[fl];
+        }
+
+        sl = __builtin_ctz(slMap);
+        return heads[fl][sl];
+    }
+
+    // findFree rounds up, so a range that fits exactly (like a dedicated block) can sit in a list below the one it
+    // searches. walk those lists instead.
+    uint32_t tlsf::scanFree(VkDeviceSize size, VkDeviceSize align) {
+        uint32_t fl, sl;
+        mapping(size, fl, sl);
+
+        for (; fl < flCount; fl++, sl = 0) {
+            for (; sl < slCount; sl++) {
+                for (uint32_t n = heads[fl][sl]; n != invalid; n = nodes[n].nextFree) {
+                    if (alignUp(nodes[n].offset, align) + size <= nodes[n].offset + nodes[n].size) {
+                        return n;
+                    }
+                }
+            }
+        }
+
+        return invalid;
+    }
+
+    uint32_t tlsf::alloc(VkDeviceSize size, VkDeviceSize align, VkDeviceSize& offset) {
+        align = std::max<VkDeviceSize>(align, 1);
+
+        uint32_t n = findFree(size + align - 1); // worst case padding needed to align the start
+        if (n == invalid) {
+            n = scanFree(size, align);
+        }
+
+        if (n == invalid) {
+            return invalid;
+        }
+
+        removeFree(n);
+
+        // padding in front goes back on the free list as its own range
+        VkDeviceSize aligned = alignUp(nodes[n].offset, align);
+        if (aligned != nodes[n].offset) {
+            uint32_t p = newNode(); // may reallocate nodes, so don't hold references across this
+            nodes[p].offset = nodes[n].offset;
+            nodes[p].size = aligned - nodes[n].offset;
+            nodes[p].prevPhys = nodes[n].prevPhys;
+            nodes[p].nextPhys = n;
+
+            if (nodes[n].prevPhys != invalid) {
+                nodes[nodes[n].prevPhys].nextPhys = p;
+            }
+
+            nodes[n].prevPhys = p;
+            nodes[n].offset = aligned;
+            nodes[n].size -= nodes[p].size;
+            insertFree(p);
+        }
+
+        // and so does whatever is left over at the end
+        if (nodes[n].size > size) {
+            uint32_t r = newNode();
+            nodes[r].offset = nodes[n].offset + size;
+            nodes[r].size = nodes[n].size - size;
+            nodes[r].prevPhys = n;
+            nodes[r].nextPhys = nodes[n].nextPhys;
+
+            if (nodes[n].nextPhys != invalid) {
+                nodes[nodes[n].nextPhys].prevPhys = r;
+            }
+
+            nodes[n].nextPhys = r;
+            nodes[n].size = size;
+            insertFree(r);
+        }
+
+        inUse += size;
+        numAllocs++;
+
+        offset = nodes[n].offset;
+        return n;
+    }
+
+    void tlsf::free(uint32_t n) {
+        if (n >= nodes.size() || nodes[n].free) {
+            throw std::runtime_error("cannot free an invalid tlsf handle!");
+        }
+
+        inUse -= nodes[n].size;
+        numAllocs--;
+
+        // merge with free neighbours so free ranges never sit next to each other
+        uint32_t prev = nodes[n].prevPhys;
+        if (prev != invalid && nodes[prev].free) {
+            removeFree(prev);
+            nodes[n].offset = nodes[prev].offset;
+            nodes[n].size += nodes[prev].size;
+            nodes[n].prevPhys = nodes[prev].prevPhys;
+            if (nodes[n].prevPhys != invalid) {
+                nodes[nodes[n].prevPhys].nextPhys = n;
+            }
+            spareNodes.push_back(prev);
+        }
+
+        uint32_t next = nodes[n].nextPhys;
+        if (next != invalid && nodes[next].free) {
+            removeFree(next);
+            nodes[n].size += nodes[next].size;
+            nodes[n].nextPhys = nodes[next].nextPhys;
+            if (nodes[n].nextPhys != invalid) {
+                nodes[nodes[n].nextPhys].prevPhys = n;
+            }
+            spareNodes.push_back(next);
+        }
+
+        insertFree(n);
+    }
+
+    VkDeviceSize tlsf::largestFree() const {
+        if (flBitmap == 0) {
+            return 0;
+        }
+
+        // size classes don't overlap, so the largest range has to be in the highest non-empty list
+        uint32_t fl = log2(flBitmap);
+        uint32_t sl = 31 - __builtin_clz(slBitmap[fl]);
+
+        VkDeviceSize largest = 0;
+        for (uint32_t n = heads[fl][sl]; n != invalid; n = nodes[n].nextFree) {
+            largest = std::max(largest, nodes[n].size);
+        }
+
+        return largest;
+    }
+
+    void allocator::create(VkPhysicalDevice pdev, VkDevice dev, bool memoryBudget) {
+        this->pdev = pdev;
+        this->dev = dev;
+        hasBudget = memoryBudget;
+
+        vkGetPhysicalDeviceMemoryProperties(pdev, &memProps);
+
+        VkPhysicalDeviceProperties dprop;
+        vkGetPhysicalDeviceProperties(pdev, &dprop);
+        granularity = dprop.limits.bufferImageGranularity;
+
+        for (uint32_t i = 0; i < memProps.memoryTypeCount; i++) {
+            VkDeviceSize heapSize = memProps.memoryHeaps[memProps.memoryTypes[i].heapIndex].size;
+            blockSize[i] = (heapSize >= largeHeapSize) ? largeHeapBlockSize : alignUp(heapSize / 8, 4096);
+        }
+
+        updateBudget();
+    }
+
+    void allocator::updateBudget() {
+        if (!hasBudget) {
+            // same rule of thumb as other allocators: don't plan on getting more than 80% of a heap
+            for (uint32_t i = 0; i < memProps.memoryHeapCount; i++) {
+                budget[i] = memProps.memoryHeaps[i].size / 10 * 8;
+            }
+
+            return;
+        }
+
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProps{};
+        budgetProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+        VkPhysicalDeviceMemoryProperties2 props2{};
+        props2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+        props2.pNext = &budgetProps;
+
+        vkGetPhysicalDeviceMemoryProperties2(pdev, &props2);
+
+        for (uint32_t i = 0; i < memProps.memoryHeapCount; i++) {
+            budget[i] = budgetProps.heapBudget[i];
+            usageAtQuery[i] = budgetProps.heapUsage[i];
+            reservedAtQuery[i] = heapReserved[i];
+        }
+    }
+
+    void allocator::trim() {
+        for (auto& typeBlocks : blocks) {
+            for (size_t i = 0; i < typeBlocks.size();) {
+                if (!typeBlocks[i]->dedicated && typeBlocks[i]->range.empty()) {
+                    destroyBlock(typeBlocks[i].get());
+                } else {
+                    i++;
+                }
+            }
+        }
+    }
+
+    void allocator::destroy() {
+        size_t leaked = 0;
+
+        for (auto& typeBlocks : blocks) {
+            for (auto& b : typeBlocks) {
+                leaked += b->range.allocations();
+                vkFreeMemory(dev, b->mem, nullptr);
+            }
+            typeBlocks.clear();
+        }
+
+        if (options::debug && leaked > 0) {
+            std::cerr << "\t" << leaked << " device memory allocations were never freed\n";
+        }
+    }
+
+    // higher is better, negative if the type can't be used at all
+    int allocator::scoreType(uint32_t type, const request& r) const {
+        VkMemoryPropertyFlags flags = memProps.memoryTypes[type].propertyFlags;
+
+        if ((flags & r.required) != r.required) {
+            return -1;
+        }
+
+        if ((flags & VK_MEMORY_PROPERTY_PROTECTED_BIT) && !(r.required & VK_MEMORY_PROPERTY_PROTECTED_BIT)) {
+            return -1;
+        }
+
+        VkMemoryPropertyFlags preferred = r.preferred;
+        VkMemoryPropertyFlags avoided = 0;
+
+        switch (r.hint) {
+            case usage::gpuOnly:
+                preferred |= VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+                avoided = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+                break;
+            case usage::upload:
+                // write-combined system memory is fine for one-off writes, and leaves device-local host-visible
+                // memory (ReBAR, often only 256 MiB) for per-frame data
+                preferred |= VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+                avoided = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+                break;
+            case usage::readback:
+                // reading uncached memory from the cpu is very slow
+                preferred |= VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+                break;
+            case usage::dynamic:
+                // the gpu reads this every frame, so put it in vram if the cpu can write there directly
+                preferred |= VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+                avoided = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+                break;
+        }
+
+        return 2 * __builtin_popcount(flags & preferred) - __builtin_popcount(flags & avoided) + 1;
+    }
+
+    // usable memory types for legalMemoryTypes, best first
+    std::vector<uint32_t> allocator::rankTypes(uint32_t legalMemoryTypes, const request& r) const {
+        std::vector<uint32_t> types;
+        std::array<int, VK_MAX_MEMORY_TYPES> scores = {};
+
+        for (uint32_t i = 0; i < memProps.memoryTypeCount; i++) {
+            scores[i] = scoreType(i, r);
+
+            if ((legalMemoryTypes & (1 << i)) && scores[i] >= 0) {
+                types.push_back(i);
+            }
+        }
+
+        std::stable_sort(types.begin(), types.end(), [&](uint32_t a, uint32_t b) {
+            if (scores[a] != scores[b]) {
+                return scores[a] > scores[b];
+            }
+
+            return heapBudget(memProps.memoryTypes[a].heapIndex) > heapBudget(memProps.memoryTypes[b].heapIndex);
+        });
+
+        return types;
+    }
+
+    VkDeviceSize allocator::heapUsage(uint32_t heap) const {
+        if (!hasBudget) {
+            return heapReserved[heap];
+        }
+
+        // the driver's number is only as fresh as the last query, so account for our own blocks since then
+        int64_t delta = int64_t(heapReserved[heap]) - int64_t(reservedAtQuery[heap]);
+        return VkDeviceSize(std::max<int64_t>(int64_t(usageAtQuery[heap]) + delta, 0));
+    }
+
+    // bytes we can still allocate from heap without going over its budget
+    VkDeviceSize allocator::heapBudget(uint32_t heap) const {
+        VkDeviceSize used = heapUsage(heap);
+        return (used < budget[heap]) ? budget[heap] - used : 0;
+    }
+
+    block* allocator::createBlock(uint32_t type, VkDeviceSize size, bool dedicated) {
+        auto b = std::make_unique<block>(size);
+        b->type = type;
+        b->dedicated = dedicated;
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = size;
+        allocInfo.memoryTypeIndex = type;
+
+        // running out is not fatal, the caller moves on to the next best memory type
+        VkResult r = vkAllocateMemory(dev, &allocInfo, nullptr, &b->mem);
+        if (r == VK_ERROR_OUT_OF_DEVICE_MEMORY || r == VK_ERROR_OUT_OF_HOST_MEMORY) {
+            return nullptr;
+        } else if (r != VK_SUCCESS) {
+            throw std::runtime_error("cannot allocate device memory!");
+        }
+
+        heapReserved[memProps.memoryTypes[type].heapIndex] += size;
+
+        // only one mapping per VkDeviceMemory is allowed, so map the whole block once and hand out pointers into it
+        if (memProps.memoryTypes[type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+            if (vkMapMemory(dev, b->mem, 0, VK_WHOLE_SIZE, 0, &b->mapped) != VK_SUCCESS) {
+                throw std::runtime_error("cannot map device memory!");
+            }
+        }
+
+        blocks[type].push_back(std::move(b));
+        return blocks[type].back().get();
+    }
+
+    void allocator::destroyBlock(block* b) {
+        vkFreeMemory(dev, b->mem, nullptr); // implicitly unmaps
+        heapReserved[memProps.memoryTypes[b->type].heapIndex] -= b->range.size();
+
+        auto& typeBlocks = blocks[b->type];
+        typeBlocks.erase(std::find_if(typeBlocks.begin(), typeBlocks.end(),
+            [b](const std::unique_ptr<block>& p) { return p.get() == b; }));
+    }
+
+    allocation allocator::alloc(const VkMemoryRequirements& req, const request& r, bool linear) {
+        VkDeviceSize size = req.size;
+        VkDeviceSize align = req.alignment;
+
+        // give optimal images whole granularity pages so no buffer can end up sharing one with them
+        if (!linear && granularity > 1) {
+            align = std::max(align, granularity);
+            size = alignUp(size, granularity);
+        }
+
+        std::vector<uint32_t> types = rankTypes(req.memoryTypeBits, r);
+        if (types.empty()) {
+            throw std::runtime_error("cannot find proper memory type!");
+        }
+
+        allocation a;
+        a.cat = r.cat;
+
+        auto attempt = [&](bool overBudget) {
+            for (uint32_t type : types) {
+                if (tryAlloc(type, size, align, overBudget, a)) {
+                    categoryUsed[size_t(a.cat)] += a.size;
+                    return true;
+                }
+            }
+
+            return false;
+        };
+
+        // stay within budget in any usable heap if at all possible
+        if (attempt(false)) {
+            return a;
+        }
+
+        // then try making room, first by dropping our own empty blocks and then by asking the app
+        trim();
+        if (attempt(false)) {
+            return a;
+        }
+
+        if (evict && evict(size) && attempt(false)) {
+            return a;
+        }
+
+        // going over budget works but may page memory out, going over the heap size would fail outright
+        if (attempt(true)) {
+            if (options::debug) {
+                std::cerr << "\tdevice memory budget exceeded for a " << size << " byte " << categoryName(r.cat) << " allocation\n";
+            }
+
+            return a;
+        }
+
+        throw std::runtime_error("device memory budget exceeded!");
+    }
+
+    bool allocator::tryAlloc(uint32_t type, VkDeviceSize size, VkDeviceSize align, bool overBudget, allocation& a) {
+        uint32_t heap = memProps.memoryTypes[type].heapIndex;
+        VkDeviceSize heapSize = memProps.memoryHeaps[heap].size;
+        VkDeviceSize budget = overBudget ? ((heapReserved[heap] < heapSize) ? heapSize - heapReserved[heap] : 0) : heapBudget(heap);
+
+        block* b = nullptr;
+        uint32_t handle = tlsf::invalid;
+        VkDeviceSize offset = 0;
+
+        if (size > blockSize[type] / 2) {
+            // big resources would waste most of a shared block, so they get their own
+            if (size > budget || !(b = createBlock(type, size, true))) {
+                return false;
+            }
+
+            handle = b->range.alloc(size, align, offset);
+        } else {
+            for (auto& candidate : blocks[type]) {
+                if (candidate->dedicated) {
+                    continue;
+                }
+
+                handle = candidate->range.alloc(size, align, offset);
+                if (handle != tlsf::invalid) {
+                    b = candidate.get();
+                    break;
+                }
+            }
+
+            if (handle == tlsf::invalid) {
+                if (blockSize[type] > budget || !(b = createBlock(type, blockSize[type], false))) {
+                    return false;
+                }
+
+                handle = b->range.alloc(size, align, offset);
+            }
+        }
+
+        // a new block always has room, so this means the tlsf is broken
+        if (handle == tlsf::invalid) {
+            throw std::runtime_error("cannot sub-allocate from a new memory block!");
+        }
+
+        a.mem = b->mem;
+        a.offset = offset;
+        a.size = size;
+        a.mapped = b->mapped ? static_cast<char*>(b->mapped) + offset : nullptr;
+        a.owner = b;
+        a.handle = handle;
+
+        return true;
+    }
+
+    // freeing an empty allocation is a no-op, same as vkFreeMemory with VK_NULL_HANDLE
+    void allocator::free(allocation& a) {
+        block* b = a.owner;
+        if (!b) {
+            return;
+        }
+
+        b->range.free(a.handle);
+        categoryUsed[size_t(a.cat)] -= a.size;
+        a = allocation{};
+
+        if (b->dedicated) {
+            destroyBlock(b);
+            return;
+        }
+
+        // keep one empty block around per type so a free followed by an alloc doesn't hit the driver twice
+        if (b->range.empty()) {
+            size_t shared = std::count_if(blocks[b->type].begin(), blocks[b->type].end(),
+                [](const std::unique_ptr<block>& p) { return !p->dedicated; });
+
+            if (shared > 1) {
+                destroyBlock(b);
+            }
+        }
+    }
+
+    stats allocator::getStats() const {
+        stats s;
+        VkDeviceSize freeBytes = 0;
+
+        for (const auto& typeBlocks : blocks) {
+            for (const auto& b : typeBlocks) {
+                s.blocks++;
+                s.allocations += b->range.allocations();
+                s.reserved += b->range.size();
+                s.used += b->range.used();
+                s.largestFree = std::max(s.largestFree, b->range.largestFree());
+                freeBytes += b->range.size() - b->range.used();
+            }
+        }
+
+        if (freeBytes > 0) {
+            s.fragmentation = 1.0f - float(s.largestFree) / float(freeBytes);
+        }
+
+        s.categories = categoryUsed;
+
+        return s;
+    }
+
+    std::vector<heapStats> allocator::getHeapStats() const {
+        std::vector<heapStats> heaps(memProps.memoryHeapCount);
+
+        for (uint32_t i = 0; i < memProps.memoryHeapCount; i++) {
+            heaps[i].size = memProps.memoryHeaps[i].size;
+            heaps[i].budget = budget[i];
+            heaps[i].usage = heapUsage(i);
+            heaps[i].reserved = heapReserved[i];
+            heaps[i].deviceLocal = memProps.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+        }
+
+        return heaps;
+    }
+}
@@ -0,0 +1,188 @@
+#pragma once
+
+#include "glfw_wrapper.hpp"
+
+#include <vector>
+#include <array>
+#include <memory>
+#include <functional>
+#include <cstdint>
+
+// Device memory sub-allocator.
+// Memory is requested from the driver in large blocks per memory type, and each block is carved up
+// with a two-level segregated fit (TLSF) allocator, so alloc and free are O(1) and adjacent free ranges
+// are merged right away.
+namespace vmem {
+
+    struct block;
+
+    // what a resource is for, only used for accounting
+    enum class category { texture, mesh, uniform, attachment, staging, other, count };
+    constexpr size_t categoryCount = size_t(category::count);
+    const char* categoryName(category c);
+
+    // TLSF over an abstract [0, size) range, independent of any vulkan object.
+    class tlsf {
+    public:
+        static constexpr uint32_t invalid = UINT32_MAX;
+
+        tlsf(VkDeviceSize size);
+
+        // returns a handle to pass to free(), or invalid if nothing fits. offset is aligned to align.
+        uint32_t alloc(VkDeviceSize size, VkDeviceSize align, VkDeviceSize& offset);
+        void free(uint32_t handle);
+
+        VkDeviceSize size() const { return total; }
+        VkDeviceSize used() const { return inUse; }
+        size_t allocations() const { return numAllocs; }
+        bool empty() const { return numAllocs == 0; }
+
+        // walks the highest non-empty size class list
+        VkDeviceSize largestFree() const;
+
+    private:
+        // first level is log2 of the size, second level splits that power of two linearly into slCount lists
+        static constexpr uint32_t slLog2 = 4;
+        static constexpr uint32_t slCount = 1 << slLog2;
+        static constexpr uint32_t flCount = 64 - slLog2 + 1;
+
+        struct node {
+            VkDeviceSize offset = 0;
+            VkDeviceSize size = 0;
+            uint32_t prevPhys = invalid; // neighbours in address order
+            uint32_t nextPhys = invalid;
+            uint32_t prevFree = invalid; // neighbours in the free list for this size class
+            uint32_t nextFree = invalid;
+            bool free = false;
+        };
+
+        std::vector<node> nodes;
+        std::vector<uint32_t> spareNodes; // recycled indices in nodes
+
+        uint64_t flBitmap = 0;
+        std::array<uint32_t, flCount> slBitmap = {};
+        std::array<std::array<uint32_t, slCount>, flCount> heads;
+
+        VkDeviceSize total = 0;
+        VkDeviceSize inUse = 0;
+        size_t numAllocs = 0;
+
+        static void mapping(VkDeviceSize size, uint32_t& fl, uint32_t& sl);
+
+        uint32_t newNode();
+        void insertFree(uint32_t n);
+        void removeFree(uint32_t n);
+        uint32_t findFree(VkDeviceSize size);
+        uint32_t scanFree(VkDeviceSize size, VkDeviceSize align);
+    };
+
+    // a sub-range of a VkDeviceMemory block
+    struct allocation {
+        VkDeviceMemory mem = VK_NULL_HANDLE;
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+        void* mapped = nullptr; // points at offset if the memory is host visible, null otherwise
+
+        block* owner = nullptr;
+        uint32_t handle = tlsf::invalid;
+        category cat = category::other;
+    };
+
+    struct block {
+        VkDeviceMemory mem = VK_NULL_HANDLE;
+        uint32_t type = 0;
+        void* mapped = nullptr; // host visible blocks stay mapped for their whole lifetime
+        bool dedicated = false; // holds exactly one resource and is released as soon as that resource is
+        tlsf range;
+
+        block(VkDeviceSize size) : range(size) {}
+    };
+
+    // what the cpu does with a resource, used to rank memory types beyond the flags that are strictly needed
+    enum class usage {
+        gpuOnly, // never touched by the cpu after creation
+        upload, // written once by the cpu and copied or read by the gpu, like staging
+        readback, // written by the gpu and read by the cpu
+        dynamic, // rewritten by the cpu every frame and read by the gpu
+    };
+
+    // required flags must all be present. preferred flags and the usage hint decide between the types left,
+    // and ties go to the heap with the most budget left.
+    struct request {
+        VkMemoryPropertyFlags required = 0;
+        VkMemoryPropertyFlags preferred = 0;
+        usage hint = usage::gpuOnly;
+        category cat = category::other;
+    };
+
+    struct stats {
+        size_t blocks = 0;
+        size_t allocations = 0;
+        VkDeviceSize reserved = 0; // bytes allocated from the driver
+        VkDeviceSize used = 0; // bytes handed out to resources
+        VkDeviceSize largestFree = 0;
+        float fragmentation = 0.0f; // 1 - largestFree / free bytes, so 0 means all free space is contiguous
+        std::array<VkDeviceSize, categoryCount> categories = {}; // bytes handed out per category
+    };
+
+    struct heapStats {
+        VkDeviceSize size = 0;
+        VkDeviceSize budget = 0; // how much of the heap this process should use, from VK_EXT_memory_budget if available
+        VkDeviceSize usage = 0; // this process' usage, including memory not allocated through us if the extension is there
+        VkDeviceSize reserved = 0; // allocated through us
+        bool deviceLocal = false;
+    };
+
+    class allocator {
+    public:
+        // memoryBudget is whether VK_EXT_memory_budget is enabled on dev
+        void create(VkPhysicalDevice pdev, VkDevice dev, bool memoryBudget);
+        void destroy();
+
+        // re-query the driver's budget, call this about once a frame
+        void updateBudget();
+
+        // called when an allocation doesn't fit in the budget of any usable heap, before going over it.
+        // should free what it can and return true if it freed anything.
+        void setEvictCallback(std::function<bool(VkDeviceSize)> callback) { evict = std::move(callback); }
+
+        // release every empty shared block, including the one normally kept around per type
+        void trim();
+
+        // linear is false for optimally tiled images, which can't share a bufferImageGranularity page with
+        // buffers or linear images.
+        allocation alloc(const VkMemoryRequirements& req, const request& r, bool linear);
+        void free(allocation& a);
+
+        stats getStats() const;
+        std::vector<heapStats> getHeapStats() const;
+
+    private:
+        VkPhysicalDevice pdev = VK_NULL_HANDLE;
+        VkDevice dev = VK_NULL_HANDLE;
+        VkPhysicalDeviceMemoryProperties memProps{};
+        VkDeviceSize granularity = 1;
+
+        std::array<VkDeviceSize, VK_MAX_MEMORY_TYPES> blockSize = {};
+        std::array<std::vector<std::unique_ptr<block>>, VK_MAX_MEMORY_TYPES> blocks;
+        std::array<VkDeviceSize, VK_MAX_MEMORY_HEAPS> heapReserved = {}; // bytes we've allocated from each heap
+        std::array<VkDeviceSize, categoryCount> categoryUsed = {};
+
+        // driver numbers as of the last updateBudget(). usage is extrapolated from how heapReserved changed since.
+        bool hasBudget = false;
+        std::array<VkDeviceSize, VK_MAX_MEMORY_HEAPS> budget = {};
+        std::array<VkDeviceSize, VK_MAX_MEMORY_HEAPS> usageAtQuery = {};
+        std::array<VkDeviceSize, VK_MAX_MEMORY_HEAPS> reservedAtQuery = {};
+
+        std::function<bool(VkDeviceSize)> evict;
+
+        int scoreType(uint32_t type, const request& r) const;
+        std::vector<uint32_t> rankTypes(uint32_t legalMemoryTypes, const request& r) const;
+        VkDeviceSize heapUsage(uint32_t heap) const;
+        VkDeviceSize heapBudget(uint32_t heap) const;
+        bool tryAlloc(uint32_t type, VkDeviceSize size, VkDeviceSize align, bool overBudget, allocation& a);
+
+        block* createBlock(uint32_t type, VkDeviceSize size, bool dedicated);
+        void destroyBlock(block* b);
+    };
+}
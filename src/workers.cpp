@@ -0,0 +1,88 @@
+#include "workers.hpp"
+
+namespace workers {
+
+    pool::pool(size_t count) {
+        threads.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            threads.emplace_back(&pool::loop, this);
+        }
+    }
+
+    pool::~pool() {
+        {
+            std::lock_guard<std::mutex> lock(m);
+            quit = true;
+        }
+
+        wake.notify_all();
+
+        for (std::thread& t : threads) {
+            t.join();
+        }
+    }
+
+    void pool::dispatch(size_t jobs, std::function<void(size_t)> fn) {
+        {
+            std::lock_guard<std::mutex> lock(m);
+            job = std::move(fn);
+            next = 0;
+            total = jobs;
+            finished = 0;
+            error = nullptr;
+        }
+
+        wake.notify_all();
+    }
+
+    void pool::wait() {
+        std::unique_lock<std::mutex> lock(m);
+        done.wait(lock, [this] { return finished == total; });
+
+        if (error) {
+            std::exception_ptr e = error;
+            error = nullptr;
+            std::rethrow_exception(e);
+        }
+    }
+
+    void pool::loop() {
+        std::unique_lock<std::mutex> lock(m);
+
+        while (true) {
+            wake.wait(lock, [this] { return quit || next < total || !tasks.empty(); });
+            if (quit) {
+                return;
+            }
+
+            if (next == total) {
+                std::function<void()> task = std::move(tasks.front());
+                tasks.pop_front();
+
+                // packaged_task keeps any exception for its future
+                lock.unlock();
+                task();
+                lock.lock();
+                continue;
+            }
+
+            // jobs are picked one at a time so a slow one doesn't hold up the rest
+            size_t i = next++;
+
+            lock.unlock();
+            try {
+                job(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> errLock(m);
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+            lock.lock();
+
+            if (++finished == total) {
+                done.notify_all();
+            }
+        }
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <future>
+#include <memory>
+#include <deque>
+#include <vector>
+#include <type_traits>
+#include <cstddef>
+
+// Thread pool.
+// A fixed set of threads that are woken up to run one batch of numbered jobs at a time, so per-frame work doesn't
+// pay for creating threads. Independent tasks with their own futures can be queued alongside the batches.
+namespace workers {
+
+    class pool {
+    public:
+        pool(size_t threads);
+        ~pool();
+
+        pool(const pool&) = delete;
+        pool& operator=(const pool&) = delete;
+
+        // runs fn(0) .. fn(jobs - 1) spread over the threads and returns right away. fn has to stay valid until wait().
+        void dispatch(size_t jobs, std::function<void(size_t)> fn);
+
+        // blocks until every job of the last dispatch is done, then rethrows the first exception a job threw
+        void wait();
+
+        // queues fn to run once on whichever thread is free and returns a future for its result, exceptions included.
+        // batches are picked up before tasks. tasks still queued when the pool is destroyed are dropped, so their
+        // futures throw std::future_error.
+        template <typename F>
+        auto async(F fn) -> std::future<std::invoke_result_t<F>> {
+            using result = std::invoke_result_t<F>;
+
+            // std::function has to be copyable and packaged_task isn't
+            auto task = std::make_shared<std::packaged_task<result()>>(std::move(fn));
+            std::future<result> f = task->get_future();
+            {
+                std::lock_guard<std::mutex> lock(m);
+                tasks.push_back([task] { (*task)(); });
+            }
+
+            wake.notify_one();
+            return f;
+        }
+
+        size_t size() const { return threads.size(); }
+
+    private:
+        std::vector<std::thread> threads;
+
+        std::mutex m;
+        std::condition_variable wake; // workers wait for a batch
+        std::condition_variable done; // wait() waits for the batch to finish
+
+        std::function<void(size_t)> job;
+        size_t next = 0; // next job to hand out
+        size_t total = 0;
+        size_t finished = 0;
+        std::exception_ptr error;
+        bool quit = false;
+
+        std::deque<std::function<void()>> tasks;
+
+        void loop();
+    };
+}